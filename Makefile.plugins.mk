@@ -12,8 +12,22 @@ DPF_BUILD_DIR ?= build
 DPF_WEBUI_NETWORK_UI ?= false
 # (WIP) Enable HTTPS and secure WebSockets
 DPF_WEBUI_NETWORK_SSL ?= false
+# Also listen on a Unix domain socket for local clients (not on Windows)
+DPF_WEBUI_NETWORK_UNIX_SOCKET ?= false
+# Serve network server load and client telemetry at /stats
+DPF_WEBUI_NETWORK_STATS ?= false
 # Build a type of Variant backed by libbson
 DPF_WEBUI_SUPPORT_BSON ?= false
+# Periodically log UI message path latency per stage to stderr
+DPF_WEBUI_MESSAGE_STATS ?= false
+# Count heap allocations per UI function handler and callback, log to stderr
+DPF_WEBUI_ALLOC_STATS ?= false
+# Back shared memory with anonymous memfd segments on Linux instead of named
+# ones, web views must be able to open /proc/<pid>/fd (not sandboxed)
+DPF_WEBUI_SHARED_MEMORY_ANONYMOUS ?= false
+# Back shared memory with huge pages on Linux, needs vm.nr_hugepages > 0 and
+# implies DPF_WEBUI_SHARED_MEMORY_ANONYMOUS
+DPF_WEBUI_SHARED_MEMORY_HUGE_PAGES ?= false
 # Automatically inject dpf.js when loading content from file://
 DPF_WEBUI_INJECT_FRAMEWORK_JS ?= false
 # Web view implementation on Linux [ gtk | cef ]
@@ -120,7 +134,11 @@ DPF_WEBUI_FILES_UI += WebUIBase.cpp \
 				   WebViewUI.cpp
 ifeq ($(DPF_WEBUI_NETWORK_UI),true)
 DPF_WEBUI_FILES_UI += NetworkUI.cpp \
-				   WebServer.cpp
+				   WebServer.cpp \
+				   AddressCache.cpp
+endif
+ifeq ($(DPF_WEBUI_ALLOC_STATS),true)
+DPF_WEBUI_FILES_UI += AllocStats.cpp
 endif
 ifeq ($(LINUX),true)
 DPF_WEBUI_FILES_UI += linux/LinuxWebViewUI.cpp \
@@ -205,6 +223,14 @@ ifeq ($(WEB_UI),true)
 	BASE_FLAGS += -I$(MBEDTLS_PATH)/include -DDPF_WEBUI_NETWORK_SSL
 	LINK_FLAGS += -L$(MBEDTLS_BUILD_PATH) -lmbedtls -lmbedcrypto -lmbedx509
 	endif
+	ifeq ($(DPF_WEBUI_NETWORK_STATS), true)
+	BASE_FLAGS += -DDPF_WEBUI_NETWORK_STATS
+	endif
+	ifeq ($(DPF_WEBUI_NETWORK_UNIX_SOCKET), true)
+	ifneq ($(WINDOWS),true)
+	BASE_FLAGS += -DDPF_WEBUI_NETWORK_UNIX_SOCKET
+	endif
+	endif
 	ifeq ($(WINDOWS),true)
 	LINK_FLAGS += -lwebsockets_static -lWs2_32
 	else
@@ -233,6 +259,22 @@ ifeq ($(WEB_UI),true)
   ifeq ($(DPF_WEBUI_PRINT_TRAFFIC),true)
   BASE_FLAGS += -DDPF_WEBUI_PRINT_TRAFFIC
   endif
+  ifeq ($(DPF_WEBUI_MESSAGE_STATS),true)
+  BASE_FLAGS += -DDPF_WEBUI_MESSAGE_STATS
+  endif
+  ifeq ($(DPF_WEBUI_ALLOC_STATS),true)
+  BASE_FLAGS += -DDPF_WEBUI_ALLOC_STATS
+  ifeq ($(LINUX),true)
+	# Bind plugin allocations to the counting operator new, see AllocStats.cpp
+	LINK_FLAGS += -Wl,-Bsymbolic-functions
+	endif
+  endif
+  ifeq ($(DPF_WEBUI_SHARED_MEMORY_ANONYMOUS),true)
+  BASE_FLAGS += -DDPF_WEBUI_SHARED_MEMORY_ANONYMOUS
+  endif
+  ifeq ($(DPF_WEBUI_SHARED_MEMORY_HUGE_PAGES),true)
+  BASE_FLAGS += -DDPF_WEBUI_SHARED_MEMORY_HUGE_PAGES
+  endif
   ifeq ($(LINUX),true)
   LINK_FLAGS += -lpthread -ldl
   endif
@@ -332,6 +374,9 @@ LWS_CMAKE_ARGS += -DLWS_WITH_SSL=1 -DLWS_WITH_MBEDTLS=1 \
 else
 LWS_CMAKE_ARGS += -DLWS_WITH_SSL=0
 endif
+ifeq ($(DPF_WEBUI_NETWORK_UNIX_SOCKET),true)
+LWS_CMAKE_ARGS += -DLWS_UNIX_SOCK=1
+endif
 
 ifeq ($(WINDOWS),true)
 LWS_LIB_PATH = $(LWS_BUILD_PATH)/lib/libwebsockets_static.a
@@ -0,0 +1,179 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2021-2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PEAK_PYRAMID_HPP
+#define PEAK_PYRAMID_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "VisualizationData.hpp"
+
+#define PEAK_PYRAMID_REGION "peaks"
+
+START_NAMESPACE_DISTRHO
+
+typedef std::vector<uint8_t> PeakVector;
+
+// Peak magnitudes of the mono downmix at several zoom levels. Level 0 bins span
+// kBaseBinFrames frames and every following level kLevelRatio times more, so
+// a client gets a bounded number of peaks per displayed pixel regardless of
+// the sample rate. Lives in shared memory, written by the plugin and read by
+// the UI. Every level is a ring of bytes quantized like VisualizationData
+// samples, write positions count bins since creation and never wrap in
+// practice.
+
+class PeakPyramid
+{
+public:
+    static constexpr int    kLevels        = 5;
+    static constexpr size_t kBaseBinFrames = 16;
+    static constexpr size_t kLevelRatio    = 4;
+    static constexpr size_t kBinsPerLevel  = 8192; // power of two
+
+    PeakPyramid()
+        : fBasePeak(0)
+        , fBaseCount(0)
+    {
+        for (int level = 0; level < kLevels; ++level) {
+            fWritePos[level] = 0;
+            fFoldPeak[level] = 0;
+            fFoldCount[level] = 0;
+        }
+    }
+
+    static size_t getBinFrames(int level) noexcept
+    {
+        size_t frames = kBaseBinFrames;
+
+        for (int i = 0; i < level; ++i) {
+            frames *= kLevelRatio;
+        }
+
+        return frames;
+    }
+
+    // Coarsest level that still provides at least one bin per pixel, -1 if
+    // even level 0 is too coarse and raw samples should be used instead
+    static int selectLevel(double framesPerPixel) noexcept
+    {
+        int level = -1;
+
+        while ((level + 1 < kLevels) && (static_cast<double>(getBinFrames(level + 1)) <= framesPerPixel)) {
+            level++;
+        }
+
+        return level;
+    }
+
+    RT_SAFE void addSamples(const float** inputs, uint32_t frames)
+    {
+        for (uint32_t i = 0; i < frames; ++i) {
+            const float k = std::fabs((inputs[0][i] + inputs[1][i]) * 0.5f);
+            fBasePeak = std::max(fBasePeak, k); // NaN is skipped
+
+            if (++fBaseCount == kBaseBinFrames) {
+                push(0, quantize(fBasePeak));
+                fBasePeak = 0;
+                fBaseCount = 0;
+            }
+        }
+    }
+
+    size_t getWritePos(int level) const noexcept
+    {
+        return fWritePos[level].load(std::memory_order_acquire);
+    }
+
+    // Copies peaks written since readPos, then advances readPos. Bins already
+    // overwritten by the plugin, before or during the copy, are skipped.
+    void readPeaks(int level, size_t& readPos, PeakVector& peaks) const
+    {
+        const size_t wpos = getWritePos(level);
+        const size_t capacity = kBinsPerLevel; // std::min() would ODR-use it
+
+        if ((readPos > wpos) || (wpos - readPos > capacity)) {
+            readPos = wpos - std::min(wpos, capacity);
+        }
+
+        const size_t start = readPos;
+        peaks.resize(wpos - start);
+
+        for (size_t pos = start; pos < wpos; ++pos) {
+            peaks[pos - start] = fBins[level][pos & (kBinsPerLevel - 1)];
+        }
+
+        // The bin at the write position can be half written, so positions up
+        // to wposAfter - capacity share their slot with a newer bin
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const size_t wposAfter = getWritePos(level);
+
+        if (wposAfter + 1 - start > capacity) {
+            const size_t stale = std::min(wposAfter + 1 - capacity - start, peaks.size());
+            peaks.erase(peaks.begin(), peaks.begin() + stale);
+        }
+
+        readPos = wpos;
+    }
+
+private:
+    static uint8_t quantize(float k) noexcept
+    {
+        k = k < 1.f ? k : 1.f;
+        return static_cast<uint8_t>(std::lrint(255.f * k));
+    }
+
+    RT_SAFE void push(int level, uint8_t peak)
+    {
+        const size_t pos = fWritePos[level].load(std::memory_order_relaxed);
+        fBins[level][pos & (kBinsPerLevel - 1)] = peak;
+        fWritePos[level].store(pos + 1, std::memory_order_release);
+
+        if (level + 1 == kLevels) {
+            return;
+        }
+
+        // Fold into the next level
+        fFoldPeak[level] = std::max(fFoldPeak[level], peak);
+
+        if (++fFoldCount[level] == kLevelRatio) {
+            push(level + 1, fFoldPeak[level]);
+            fFoldPeak[level] = 0;
+            fFoldCount[level] = 0;
+        }
+    }
+
+    typedef std::atomic<size_t> AtomicSize;
+
+    uint8_t    fBins[kLevels][kBinsPerLevel];
+    AtomicSize fWritePos[kLevels];
+
+    // Plugin only
+    float      fBasePeak;
+    size_t     fBaseCount;
+    uint8_t    fFoldPeak[kLevels];
+    size_t     fFoldCount[kLevels];
+
+    DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PeakPyramid)
+};
+
+END_NAMESPACE_DISTRHO
+
+#endif // PEAK_PYRAMID_HPP
@@ -0,0 +1,313 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2021-2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPECTRUM_ANALYZER_HPP
+#define SPECTRUM_ANALYZER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "VisualizationData.hpp"
+
+#define SPECTRUM_INPUT_REGION "spectrum"
+
+START_NAMESPACE_DISTRHO
+
+constexpr size_t kSpectrumMinBins = 8;
+constexpr size_t kSpectrumMaxBins = 1024;
+constexpr float  kSpectrumMinDb   = -96.f;
+constexpr float  kSpectrumMinFreq = 20.f;
+
+typedef std::vector<uint8_t> SpectrumVector;
+
+// Full resolution mono downmix for the analyzer, 8-bit visualization samples
+// are too coarse for it. Lives in shared memory, written by the plugin and
+// read by the UI. The write position counts frames since creation.
+
+class SpectrumInput
+{
+public:
+    static constexpr size_t kSize = 16384; // power of two
+
+    SpectrumInput()
+        : fWritePos(0)
+    {}
+
+    RT_SAFE void addSamples(const float** inputs, uint32_t frames)
+    {
+        const size_t wpos = fWritePos.load(std::memory_order_relaxed);
+        size_t i = wpos & (kSize - 1);
+        size_t j = 0;
+
+        // Contiguous spans split at the ring wrap point
+        while (j < frames) {
+            const size_t n = std::min(static_cast<size_t>(frames) - j, kSize - i);
+            const float* l = inputs[0] + j;
+            const float* r = inputs[1] + j;
+            float* out = fSamples + i;
+
+            for (size_t k = 0; k < n; ++k) {
+                out[k] = (l[k] + r[k]) * 0.5f;
+            }
+
+            i = (i + n) & (kSize - 1);
+            j += n;
+        }
+
+        fWritePos.store(wpos + frames, std::memory_order_release);
+    }
+
+    size_t getWritePos() const noexcept
+    {
+        return fWritePos.load(std::memory_order_acquire);
+    }
+
+    // Copies the count samples preceding writePos, count must not exceed kSize
+    void read(size_t writePos, float* samples, size_t count) const
+    {
+        const size_t start = (writePos - count) & (kSize - 1);
+        const size_t tail = std::min(count, kSize - start);
+
+        std::copy(fSamples + start, fSamples + start + tail, samples);
+        std::copy(fSamples, fSamples + count - tail, samples + tail);
+    }
+
+private:
+    typedef std::atomic<size_t> AtomicSize;
+
+    float      fSamples[kSize];
+    AtomicSize fWritePos;
+
+    DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumInput)
+};
+
+// Windowed FFT of the latest SpectrumInput samples, runs on the UI thread.
+// Window, twiddle factors and bit reversal permutation are computed once.
+// Magnitudes are published as log spaced bins from kSpectrumMinFreq to the
+// Nyquist frequency, in dB quantized from kSpectrumMinDb (0) to 0 dB (255).
+
+class SpectrumAnalyzer
+{
+public:
+    // fftSize must be a power of two, it is limited to SpectrumInput::kSize
+    SpectrumAnalyzer(size_t fftSize = 2048)
+        : fSize(fftSize)
+        , fLastWritePos(0)
+        , fSampleRate(0)
+    {
+        const size_t maxSize = SpectrumInput::kSize; // std::min() would ODR-use it
+        fSize = std::min(fSize, maxSize);
+
+        fWindow.resize(fSize);
+        fInput.resize(fSize);
+        fRe.resize(fSize);
+        fIm.resize(fSize);
+        fDb.assign(fSize / 2 + 1, kSpectrumMinDb);
+        fReverse.resize(fSize);
+        fTwRe.resize(fSize - 1);
+        fTwIm.resize(fSize - 1);
+
+        double windowSum = 0;
+
+        for (size_t i = 0; i < fSize; ++i) {
+            fWindow[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * i / fSize)); // Hann
+            windowSum += fWindow[i];
+        }
+
+        fNorm = static_cast<float>(2.0 / windowSum);
+
+        size_t bits = 0;
+
+        while ((static_cast<size_t>(1) << bits) < fSize) {
+            bits++;
+        }
+
+        for (size_t i = 0; i < fSize; ++i) {
+            size_t r = 0;
+
+            for (size_t b = 0; b < bits; ++b) {
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            }
+
+            fReverse[i] = r;
+        }
+
+        // Stage with half size h uses h contiguous twiddles starting at h - 1
+        for (size_t h = 1; h < fSize; h *= 2) {
+            for (size_t k = 0; k < h; ++k) {
+                fTwRe[h - 1 + k] = static_cast<float>(std::cos(-M_PI * k / h));
+                fTwIm[h - 1 + k] = static_cast<float>(std::sin(-M_PI * k / h));
+            }
+        }
+    }
+
+    // Analyzes the latest samples, returns false if there were none since the
+    // previous call
+    bool process(const SpectrumInput& input)
+    {
+        const size_t wpos = input.getWritePos();
+
+        if (wpos == fLastWritePos) {
+            return false;
+        }
+
+        fLastWritePos = wpos;
+        input.read(wpos, fInput.data(), fSize);
+
+        for (size_t i = 0; i < fSize; ++i) {
+            const size_t r = fReverse[i];
+            fRe[r] = fInput[i] * fWindow[i];
+            fIm[r] = 0;
+        }
+
+        transform();
+
+        for (size_t k = 0; k < fDb.size(); ++k) {
+            const float mag = std::sqrt(fRe[k] * fRe[k] + fIm[k] * fIm[k]) * fNorm;
+            const float db = 20.f * std::log10(mag + 1e-9f);
+            fDb[k] = db > kSpectrumMinDb ? db : kSpectrumMinDb; // NaN maps to the floor
+        }
+
+        return true;
+    }
+
+    void getBins(size_t count, double sampleRate, SpectrumVector& bins)
+    {
+        const std::vector<BinRange>& ranges = getRanges(count, sampleRate);
+        bins.resize(count);
+
+        for (size_t i = 0; i < count; ++i) {
+            const float db = *std::max_element(fDb.cbegin() + ranges[i].first, fDb.cbegin() + ranges[i].second);
+            float k = (db - kSpectrumMinDb) / -kSpectrumMinDb;
+            k = k > 0.f ? (k < 1.f ? k : 1.f) : 0.f; // NaN maps to 0
+            bins[i] = static_cast<uint8_t>(std::lrint(255.f * k));
+        }
+    }
+
+private:
+    typedef std::pair<size_t, size_t> BinRange; // FFT bins [first, second)
+
+    // In place radix-2 over split real and imaginary arrays, input must be in
+    // bit reversed order. Inner loops run over contiguous twiddles.
+    void transform()
+    {
+        float* re = fRe.data();
+        float* im = fIm.data();
+
+        for (size_t h = 1; h < fSize; h *= 2) {
+            const float* wr = fTwRe.data() + h - 1;
+            const float* wi = fTwIm.data() + h - 1;
+
+            for (size_t g = 0; g < fSize; g += 2 * h) {
+                float* ar = re + g;
+                float* ai = im + g;
+                float* br = re + g + h;
+                float* bi = im + g + h;
+                size_t k = 0;
+#if defined(__SSE2__)
+                for (; k + 4 <= h; k += 4) {
+                    const __m128 vwr = _mm_loadu_ps(wr + k), vwi = _mm_loadu_ps(wi + k);
+                    const __m128 vbr = _mm_loadu_ps(br + k), vbi = _mm_loadu_ps(bi + k);
+                    const __m128 var = _mm_loadu_ps(ar + k), vai = _mm_loadu_ps(ai + k);
+                    const __m128 tr = _mm_sub_ps(_mm_mul_ps(vwr, vbr), _mm_mul_ps(vwi, vbi));
+                    const __m128 ti = _mm_add_ps(_mm_mul_ps(vwr, vbi), _mm_mul_ps(vwi, vbr));
+                    _mm_storeu_ps(br + k, _mm_sub_ps(var, tr));
+                    _mm_storeu_ps(bi + k, _mm_sub_ps(vai, ti));
+                    _mm_storeu_ps(ar + k, _mm_add_ps(var, tr));
+                    _mm_storeu_ps(ai + k, _mm_add_ps(vai, ti));
+                }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+                for (; k + 4 <= h; k += 4) {
+                    const float32x4_t vwr = vld1q_f32(wr + k), vwi = vld1q_f32(wi + k);
+                    const float32x4_t vbr = vld1q_f32(br + k), vbi = vld1q_f32(bi + k);
+                    const float32x4_t var = vld1q_f32(ar + k), vai = vld1q_f32(ai + k);
+                    const float32x4_t tr = vmlsq_f32(vmulq_f32(vwr, vbr), vwi, vbi);
+                    const float32x4_t ti = vmlaq_f32(vmulq_f32(vwr, vbi), vwi, vbr);
+                    vst1q_f32(br + k, vsubq_f32(var, tr));
+                    vst1q_f32(bi + k, vsubq_f32(vai, ti));
+                    vst1q_f32(ar + k, vaddq_f32(var, tr));
+                    vst1q_f32(ai + k, vaddq_f32(vai, ti));
+                }
+#endif
+                for (; k < h; ++k) {
+                    const float tr = wr[k] * br[k] - wi[k] * bi[k];
+                    const float ti = wr[k] * bi[k] + wi[k] * br[k];
+                    br[k] = ar[k] - tr;
+                    bi[k] = ai[k] - ti;
+                    ar[k] += tr;
+                    ai[k] += ti;
+                }
+            }
+        }
+    }
+
+    // Log spaced ranges are cached per bin count until the sample rate changes
+    const std::vector<BinRange>& getRanges(size_t count, double sampleRate)
+    {
+        if (sampleRate != fSampleRate) {
+            fSampleRate = sampleRate;
+            fRanges.clear();
+        }
+
+        std::vector<BinRange>& ranges = fRanges[count];
+
+        if (! ranges.empty()) {
+            return ranges;
+        }
+
+        const double hzPerBin = sampleRate / fSize;
+        const double nyquist = sampleRate / 2;
+        const double ratio = nyquist / kSpectrumMinFreq;
+        const size_t last = fDb.size();
+
+        for (size_t i = 0; i < count; ++i) {
+            const double lo = kSpectrumMinFreq * std::pow(ratio, static_cast<double>(i) / count);
+            const double hi = kSpectrumMinFreq * std::pow(ratio, static_cast<double>(i + 1) / count);
+            size_t first = std::min(static_cast<size_t>(lo / hzPerBin + 0.5), last - 1);
+            size_t second = std::min(static_cast<size_t>(hi / hzPerBin + 0.5), last);
+            ranges.push_back(BinRange(first, std::max(second, first + 1))); // at least one
+        }
+
+        return ranges;
+    }
+
+    size_t fSize;
+    size_t fLastWritePos;
+    double fSampleRate;
+    float  fNorm;
+
+    std::vector<float>  fWindow;
+    std::vector<float>  fInput;
+    std::vector<float>  fRe;
+    std::vector<float>  fIm;
+    std::vector<float>  fDb;
+    std::vector<size_t> fReverse;
+    std::vector<float>  fTwRe;
+    std::vector<float>  fTwIm;
+
+    std::unordered_map<size_t, std::vector<BinRange>> fRanges;
+
+};
+
+END_NAMESPACE_DISTRHO
+
+#endif // SPECTRUM_ANALYZER_HPP
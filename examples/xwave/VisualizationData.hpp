@@ -16,33 +16,54 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <atomic>
-#include <chrono>
+#include <cmath>
 #include <vector>
 
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+# include <arm_neon.h>
+#endif
+
 #include "WebUI.hpp"
 
 #ifndef VISUALIZATION_DATA_HPP
 #define VISUALIZATION_DATA_HPP
 
-#define SAMPLE_BUFFER_SIZE (DPF_WEBUI_SHARED_MEMORY_SIZE - /* this */1024)
+#define SAMPLE_BUFFER_SIZE 524288
+
+#define VISUALIZATION_DATA_REGION "samples"
 
 #define RT_SAFE
 
 START_NAMESPACE_DISTRHO
 
-constexpr double kFrequencyLocal   = 30.0;
-constexpr double kFrequencyNetwork = 10.0;
+constexpr double kFrequencyLocal      = 30.0;
+constexpr double kFrequencyNetwork    = 10.0; // initial rate for network clients
+constexpr double kFrequencyNetworkMin = 2.0;
+constexpr double kFrequencyNetworkMax = 30.0;
+constexpr size_t kMaxDecimation       = 8;
+constexpr size_t kMaxQueueDepth       = 2;     // frames waiting in the server queue
+constexpr double kMaxRtt              = 250.0; // ms
+
+typedef std::vector<uint8_t> SampleVector;
+
+// Lives in shared memory, written by the plugin and read by the UI. Readers
+// keep their own read position so multiple streams can consume the samples.
+// Samples are the magnitude of the mono downmix quantized to 0-255. With an
+// input decimation greater than one the plugin stores the peak of every
+// group of that many frames, so the UI must scale the sample rate down.
 
 class VisualizationData
 {
 public:
-    VisualizationData()
-        : fSendTimeLocal(0)
-        , fSendTimeNetwork(0)
-        , fReadPosLocal(0)
-        , fReadPosNetwork(0)
-        , fWritePos(0)
+    VisualizationData(size_t inputDecimation = 1)
+        : fWritePos(0)
+        , fInputDecimation(std::max(inputDecimation, static_cast<size_t>(1)))
+        , fPeak(0)
+        , fPeakCount(0)
     {}
 
     ~VisualizationData()
@@ -50,94 +71,207 @@ public:
 
     RT_SAFE void addSamples(const float** inputs, uint32_t frames)
     {
-        size_t i = fWritePos;
+        size_t i = fWritePos.load(std::memory_order_relaxed);
         size_t j = 0;
 
-        while (j < frames) {
-            float k = inputs[0][j] + inputs[1][j] / 2.f;
-            k = 1.f + ((k < -1.f) ? -1.f : ((k > 1.f) ? 1.f : k));
-
-            fSamplesIn[i] = static_cast<uint8_t>(255.f * k - 255.f);
-
-            i++;
-            j++;
-
-            if (i == sizeof(fSamplesIn)) {
-                i = 0;
+        if (fInputDecimation == 1) {
+            // Contiguous spans split at the ring wrap point
+            while (j < frames) {
+                const size_t n = std::min(static_cast<size_t>(frames) - j, sizeof(fSamplesIn) - i);
+                quantize(inputs[0] + j, inputs[1] + j, fSamplesIn + i, n);
+                i = (i + n) % sizeof(fSamplesIn);
+                j += n;
+            }
+        } else {
+            uint8_t chunk[256];
+
+            while (j < frames) {
+                const size_t n = std::min(static_cast<size_t>(frames) - j, sizeof(chunk));
+                quantize(inputs[0] + j, inputs[1] + j, chunk, n);
+                j += n;
+
+                for (size_t k = 0; k < n; ++k) {
+                    fPeak = std::max(fPeak, chunk[k]);
+
+                    if (++fPeakCount == fInputDecimation) {
+                        fSamplesIn[i] = fPeak;
+                        i = (i + 1) % sizeof(fSamplesIn);
+                        fPeak = 0;
+                        fPeakCount = 0;
+                    }
+                }
             }
         }
 
-        fWritePos = i;
+        fWritePos.store(i, std::memory_order_release);
     }
 
-    void send(WebUI& ui)
+    size_t getWritePos() const noexcept
     {
-        double now = static_cast<double>(
-            std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::system_clock::now().time_since_epoch()
-            ).count()
-        ) / 1000.0;
-
-        if ((now - fSendTimeLocal) >= (1.0 / kFrequencyLocal)) {
-            fSendTimeLocal = now;
+        return fWritePos;
+    }
 
-            Variant visData = Variant::createObject({
-                { "samples", getSamples(fReadPosLocal) }
-            });
+    size_t getInputDecimation() const noexcept
+    {
+        return fInputDecimation;
+    }
 
-            ui.callback("onVisualizationData", Variant::createArray({ visData }),
-                kDestinationWebView);
-        }
+    // Copies samples written since readPos keeping the peak of every
+    // decimation samples, then advances readPos
+    void readSamples(size_t& readPos, SampleVector& samples, size_t decimation = 1)
+    {
+        const size_t wpos = fWritePos.load(std::memory_order_acquire);
+        const size_t size = sizeof(fSamplesIn);
+        const size_t count = (wpos + size - readPos) % size;
+
+        if (decimation == 1) {
+            // [--R>>>W--] or [>>W---R>>]
+            const size_t tail = std::min(count, size - readPos);
+            samples.assign(fSamplesIn + readPos, fSamplesIn + readPos + tail);
+            samples.insert(samples.end(), fSamplesIn, fSamplesIn + count - tail);
+        } else {
+            samples.clear();
+            samples.reserve(count / decimation + 1);
 
-        if ((now - fSendTimeNetwork) >= (1.0 / kFrequencyNetwork)) {
-            fSendTimeNetwork = now;
+            for (size_t n = 0; n < count; n += decimation) {
+                const size_t m = std::min(decimation, count - n);
+                uint8_t peak = 0;
 
-            Variant visData = Variant::createObject({
-                { "samples", getSamples(fReadPosNetwork) }
-            });
+                for (size_t k = 0; k < m; ++k) {
+                    peak = std::max(peak, fSamplesIn[(readPos + n + k) % size]);
+                }
 
-            ui.callback("onVisualizationData", Variant::createArray({ visData }),
-                kDestinationAll, /*exclude*/kDestinationWebView);
+                samples.push_back(peak);
+            }
         }
+
+        readPos = wpos;
     }
 
 private:
-    typedef std::vector<uint8_t> SampleVector;
-    typedef std::atomic_flag     AtomicFlag;
-    typedef std::atomic<size_t>  AtomicSize;
+    typedef std::atomic<size_t> AtomicSize;
 
-    const SampleVector& getSamples(AtomicSize& readPos)
+    // out[n] = round(min(|(l[n] + r[n]) / 2|, 1) * 255), NaN maps to 255
+    static RT_SAFE void quantize(const float* l, const float* r, uint8_t* out, size_t frames)
     {
-        size_t rpos = readPos;
-        size_t wpos = fWritePos;
+        size_t n = 0;
+
+#if defined(__SSE2__)
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 scale = _mm_set1_ps(255.f);
+
+        for (; n + 16 <= frames; n += 16) {
+            __m128i q[4];
+
+            for (int v = 0; v < 4; ++v) {
+                __m128 k = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(l + n + 4 * v),
+                                                 _mm_loadu_ps(r + n + 4 * v)), half);
+                k = _mm_min_ps(_mm_and_ps(k, absMask), one); // second operand on NaN
+                q[v] = _mm_cvtps_epi32(_mm_mul_ps(k, scale)); // round to nearest
+            }
 
-        if (wpos > rpos) {
-            // [--R>>>W--]
-            fSamplesOut.assign(fSamplesIn + rpos, fSamplesIn + wpos);
-        } else {
-            // [>>W---R>>]
-            fSamplesOut.assign(fSamplesIn + rpos, fSamplesIn + sizeof(fSamplesIn) - 1);
-            fSamplesOut.insert(fSamplesOut.end(), fSamplesIn, fSamplesIn + wpos);
+            const __m128i lo = _mm_packs_epi32(q[0], q[1]);
+            const __m128i hi = _mm_packs_epi32(q[2], q[3]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + n), _mm_packus_epi16(lo, hi));
         }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        const float32x4_t one = vdupq_n_f32(1.f);
 
-        readPos = wpos;
+        for (; n + 16 <= frames; n += 16) {
+            uint16x4_t q[4];
 
-        return fSamplesOut;
-    }
+            for (int v = 0; v < 4; ++v) {
+                float32x4_t k = vmulq_n_f32(vaddq_f32(vld1q_f32(l + n + 4 * v),
+                                                      vld1q_f32(r + n + 4 * v)), 0.5f);
+                k = vminnmq_f32(vabsq_f32(k), one); // number operand on NaN
+                q[v] = vqmovun_s32(vcvtnq_s32_f32(vmulq_n_f32(k, 255.f)));
+            }
 
-    uint8_t      fSamplesIn[SAMPLE_BUFFER_SIZE];
-    SampleVector fSamplesOut;
+            const uint8x8_t lo = vqmovn_u16(vcombine_u16(q[0], q[1]));
+            const uint8x8_t hi = vqmovn_u16(vcombine_u16(q[2], q[3]));
+            vst1q_u8(out + n, vcombine_u8(lo, hi));
+        }
+#endif
 
-    double fSendTimeLocal;
-    double fSendTimeNetwork;
+        for (; n < frames; ++n) {
+            float k = (l[n] + r[n]) * 0.5f;
+            k = k < 0.f ? -k : k;
+            k = k < 1.f ? k : 1.f;
+            out[n] = static_cast<uint8_t>(std::lrint(255.f * k)); // ties to even like SIMD
+        }
+    }
 
-    AtomicSize fReadPosLocal;
-    AtomicSize fReadPosNetwork;
+    uint8_t    fSamplesIn[SAMPLE_BUFFER_SIZE];
     AtomicSize fWritePos;
+    size_t     fInputDecimation;
+    uint8_t    fPeak;      // plugin only
+    size_t     fPeakCount; // plugin only
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VisualizationData)
 };
 
+// Per network client stream state, lives in the UI. The rate follows the
+// client display refresh rate and backs off when the server send queue grows
+// or the round trip time goes up. Once at the minimum rate samples are
+// decimated instead. Streams for hidden pages are paused. Clients that report
+// their display width receive peaks instead of samples, see PeakPyramid.
+
+struct VisualizationStream
+{
+    VisualizationStream(size_t readPos = 0)
+        : readPos(readPos)
+        , sendTime(0)
+        , frequency(kFrequencyNetwork)
+        , decimation(1)
+        , clientFrameRate(0)
+        , clientDisplayBins(0)
+        , peakLevel(-1)
+        , peakReadPos(0)
+        , spectrumBins(0)
+        , paused(false)
+    {}
+
+    // Frames covered by every display bin on the client, 0 if unknown
+    double getFramesPerBin(double sampleRate) const
+    {
+        return (clientFrameRate > 0) && (clientDisplayBins > 0)
+                ? sampleRate / clientFrameRate / clientDisplayBins : 0;
+    }
+
+    void update(size_t queueDepth, double rtt)
+    {
+        const double target = clientFrameRate > 0 ? std::min(clientFrameRate, kFrequencyNetworkMax)
+                                : kFrequencyNetwork;
+
+        if ((queueDepth > kMaxQueueDepth) || (rtt > kMaxRtt)) {
+            if (frequency > kFrequencyNetworkMin) {
+                frequency = std::max(frequency / 2.0, kFrequencyNetworkMin);
+            } else if (decimation < kMaxDecimation) {
+                decimation *= 2;
+            }
+        } else if (decimation > 1) {
+            decimation /= 2;
+        } else {
+            frequency = std::min(frequency + 1.0, target);
+        }
+
+        frequency = std::min(frequency, std::max(target, kFrequencyNetworkMin));
+    }
+
+    size_t readPos;
+    double sendTime;
+    double frequency;
+    size_t decimation;
+    double clientFrameRate;   // reported by the client, 0 if unknown
+    double clientDisplayBins; // reported by the client, 0 if unknown
+    int    peakLevel;         // -1 for samples
+    size_t peakReadPos;
+    size_t spectrumBins;      // selected by the client, 0 if disabled
+    bool   paused;
+};
+
 END_NAMESPACE_DISTRHO
 
 #endif // VISUALIZATION_DATA_HPP
@@ -20,6 +20,8 @@
 
 #include "extra/PluginEx.hpp"
 #include "VisualizationData.hpp"
+#include "PeakPyramid.hpp"
+#include "SpectrumAnalyzer.hpp"
 
 START_NAMESPACE_DISTRHO
 
@@ -29,6 +31,8 @@ public:
     XWaveExamplePlugin()
         : PluginEx(0 /*parameters*/, 0 /*programs*/, 0 /*states*/)
         , fVisData(nullptr)
+        , fPeaks(nullptr)
+        , fSpectrumInput(nullptr)
     {}
 
     const char* getLabel() const noexcept override
@@ -70,37 +74,39 @@ public:
 
     void sharedMemoryConnected(uint8_t* ptr) override
     {
-        fVisData = reinterpret_cast<VisualizationData*>(ptr);
+        (void)ptr;
+        fVisData = reinterpret_cast<VisualizationData*>(getSharedMemoryRegion(VISUALIZATION_DATA_REGION));
+        fPeaks = reinterpret_cast<PeakPyramid*>(getSharedMemoryRegion(PEAK_PYRAMID_REGION));
+        fSpectrumInput = reinterpret_cast<SpectrumInput*>(getSharedMemoryRegion(SPECTRUM_INPUT_REGION));
     }
 
     void sharedMemoryWillDisconnect() override
     {
-        if (fVisData != nullptr) {
-            if (fVisDataBusy.test_and_set()) {
-                // fVisDataBusy was true, wait for current render cycle to end.
-                // The max wait counter only seems to be required on Windows,
-                // where the wait loop can sometimes result in a deadlock.
-                // Behavior reproducible on REAPER, not tested on other DAWs.
-                int maxWaitMs = 1000;
-                while ((maxWaitMs-- > 0) && fVisDataBusy.test_and_set()) {
-                    d_msleep(1);
-                }
-            } else {
-                // fVisDataBusy was false and now true, free to proceed.
-            }
-            fVisData = nullptr;
-            fVisDataBusy.clear();
-        }
+        // No need to wait for the current render cycle to end, PluginEx keeps
+        // the memory mapped for one more connection cycle
+        fVisData = nullptr;
+        fPeaks = nullptr;
+        fSpectrumInput = nullptr;
     }
 
     void run(const float** inputs, float** outputs, uint32_t frames) override
     {
-        if (! fVisDataBusy.test_and_set()) {
-            if (fVisData != nullptr) {
-                fVisData->addSamples(inputs, frames);
-            }
-            
-            fVisDataBusy.clear();
+        VisualizationData* visData = fVisData;
+
+        if (visData != nullptr) {
+            visData->addSamples(inputs, frames);
+        }
+
+        PeakPyramid* peaks = fPeaks;
+
+        if (peaks != nullptr) {
+            peaks->addSamples(inputs, frames);
+        }
+
+        SpectrumInput* spectrumInput = fSpectrumInput;
+
+        if (spectrumInput != nullptr) {
+            spectrumInput->addSamples(inputs, frames);
         }
 
         for (int i = 0; i < 2; ++i) {
@@ -109,8 +115,9 @@ public:
     }
 
 private:
-    std::atomic_flag   fVisDataBusy;
-    VisualizationData* fVisData;
+    std::atomic<VisualizationData*> fVisData;
+    std::atomic<PeakPyramid*>       fPeaks;
+    std::atomic<SpectrumInput*>     fSpectrumInput;
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(XWaveExamplePlugin)
 
@@ -16,8 +16,15 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <chrono>
+#include <unordered_map>
+
 #include "WebUI.hpp"
 #include "VisualizationData.hpp"
+#include "PeakPyramid.hpp"
+#include "SpectrumAnalyzer.hpp"
+
+constexpr double kStreamUpdateInterval = 0.25; // s
 
 class XWaveExampleUI : public WebUI
 {
@@ -25,7 +32,49 @@ public:
     XWaveExampleUI()
         : WebUI(640 /*width*/, 96 /*height*/, "#0B1824" /*background*/)
         , fVisData(nullptr)
-    {}
+        , fPeaks(nullptr)
+        , fSpectrumInput(nullptr)
+        , fSpectrumBinsLocal(0)
+        , fReadPosLocal(0)
+        , fSendTimeLocal(0)
+        , fStreamUpdateTime(0)
+    {
+        // Clients report their display refresh rate, page visibility and
+        // number of bins drawn per display frame
+        setFunctionHandler("setVisualizationClientState", 3, [this](const Variant& args, uintptr_t origin) {
+            const double frameRate = args[0].getNumber();
+            const bool visible = args[1].getBoolean();
+            const double displayBins = args[2].getNumber();
+
+            queue([this, origin, frameRate, visible, displayBins] {
+                VisualizationStream* stream = getStream(reinterpret_cast<Client>(origin));
+                if (stream != nullptr) {
+                    stream->clientFrameRate = frameRate;
+                    stream->clientDisplayBins = displayBins;
+                    stream->paused = ! visible;
+                }
+            });
+        });
+
+        // Clients opt in to onSpectrumData() by choosing a number of bins,
+        // 0 disables it. Data is sent along with the waveform data.
+        setFunctionHandler("setSpectrumResolution", 1, [this](const Variant& args, uintptr_t origin) {
+            size_t bins = static_cast<size_t>(args[0].getNumber());
+
+            if (bins != 0) {
+                bins = std::min(std::max(bins, kSpectrumMinBins), kSpectrumMaxBins);
+            }
+
+            queue([this, origin, bins] {
+                VisualizationStream* stream = getStream(reinterpret_cast<Client>(origin));
+                if (stream != nullptr) {
+                    stream->spectrumBins = bins;
+                } else {
+                    fSpectrumBinsLocal = bins;
+                }
+            });
+        });
+    }
 
     ~XWaveExampleUI()
     {
@@ -35,24 +84,211 @@ public:
             fVisData->~VisualizationData();
             fVisData = nullptr;
         }
+
+        if (fPeaks != nullptr) {
+            fPeaks->~PeakPyramid();
+            fPeaks = nullptr;
+        }
+
+        if (fSpectrumInput != nullptr) {
+            fSpectrumInput->~SpectrumInput();
+            fSpectrumInput = nullptr;
+        }
     }
 
     void sharedMemoryCreated(uint8_t* ptr) override
     {
-        fVisData =  new(ptr) VisualizationData();
+        (void)ptr;
+        uint8_t* region = createSharedMemoryRegion(VISUALIZATION_DATA_REGION, sizeof(VisualizationData));
+
+        if (region != nullptr) {
+            fVisData = new(region) VisualizationData();
+        } else {
+            d_stderr2("XWaveExampleUI : could not create shared memory region");
+        }
+
+        region = createSharedMemoryRegion(PEAK_PYRAMID_REGION, sizeof(PeakPyramid));
+
+        if (region != nullptr) {
+            fPeaks = new(region) PeakPyramid();
+        }
+
+        region = createSharedMemoryRegion(SPECTRUM_INPUT_REGION, sizeof(SpectrumInput));
+
+        if (region != nullptr) {
+            fSpectrumInput = new(region) SpectrumInput();
+        }
     }
 
     void uiIdle() override
     {
         WebUI::uiIdle();
 
-        if (fVisData != nullptr) {
-            fVisData->send(*this);
+        if (fVisData == nullptr) {
+            return;
+        }
+
+        const double now = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()
+            ).count()
+        ) / 1000.0;
+
+        if ((now - fSendTimeLocal) >= (1.0 / kFrequencyLocal)) {
+            fSendTimeLocal = now;
+            fVisData->readSamples(fReadPosLocal, fSamples);
+            send(kDestinationWebView, 1);
+            sendSpectrum(kDestinationWebView, fSpectrumBinsLocal);
+        }
+
+        if ((now - fStreamUpdateTime) >= kStreamUpdateInterval) {
+            fStreamUpdateTime = now;
+            updateStreams();
+        }
+
+        for (StreamMap::iterator it = fStreams.begin(); it != fStreams.end(); ++it) {
+            VisualizationStream& stream = it->second;
+
+            if (stream.paused) {
+                stream.readPos = fVisData->getWritePos(); // drop samples
+                stream.peakLevel = -1; // and peaks
+                continue;
+            }
+
+            if ((now - stream.sendTime) >= (1.0 / stream.frequency)) {
+                stream.sendTime = now;
+
+                if (updatePeakLevel(stream)) {
+                    fPeaks->readPeaks(stream.peakLevel, stream.peakReadPos, fPeakBuffer);
+                    sendPeaks(reinterpret_cast<uintptr_t>(it->first), stream.peakLevel);
+                } else {
+                    fVisData->readSamples(stream.readPos, fSamples, stream.decimation);
+                    send(reinterpret_cast<uintptr_t>(it->first), stream.decimation);
+                }
+
+                sendSpectrum(reinterpret_cast<uintptr_t>(it->first), stream.spectrumBins);
+            }
         }
     }
 
 private:
+    typedef std::unordered_map<Client, VisualizationStream> StreamMap;
+
+    void send(uintptr_t destination, size_t decimation)
+    {
+        // Clients derive the stream sample rate from the total decimation
+        decimation *= fVisData->getInputDecimation();
+
+        Variant visData = Variant::createObject({
+            { "samples", fSamples },
+            { "decimation", static_cast<uint32_t>(decimation) }
+        });
+
+        callback("onVisualizationData", Variant::createArray({ visData }), destination);
+    }
+
+    void sendPeaks(uintptr_t destination, int level)
+    {
+        Variant peakData = Variant::createObject({
+            { "peaks", fPeakBuffer },
+            { "framesPerPeak", static_cast<uint32_t>(PeakPyramid::getBinFrames(level)) }
+        });
+
+        callback("onVisualizationPeaks", Variant::createArray({ peakData }), destination);
+    }
+
+    void sendSpectrum(uintptr_t destination, size_t bins)
+    {
+        if ((bins == 0) || (fSpectrumInput == nullptr)) {
+            return;
+        }
+
+        // No-op when already run for the current samples during this uiIdle()
+        fSpectrum.process(*fSpectrumInput);
+        fSpectrum.getBins(bins, getSampleRate(), fSpectrumBins);
+
+        Variant spectrumData = Variant::createObject({
+            { "bins", fSpectrumBins },
+            { "minFrequency", kSpectrumMinFreq },
+            { "minDb", kSpectrumMinDb }
+        });
+
+        callback("onSpectrumData", Variant::createArray({ spectrumData }), destination);
+    }
+
+    // Picks the pyramid level matching the client display resolution, stream
+    // decimation moves to coarser levels. Returns false to send samples.
+    bool updatePeakLevel(VisualizationStream& stream)
+    {
+        const double framesPerBin = stream.getFramesPerBin(getSampleRate());
+        const int level = (fPeaks != nullptr) && (framesPerBin > 0)
+                            ? PeakPyramid::selectLevel(framesPerBin * stream.decimation) : -1;
+
+        if (level != stream.peakLevel) {
+            stream.peakLevel = level;
+
+            if (level != -1) {
+                stream.peakReadPos = fPeaks->getWritePos(level);
+            } else {
+                stream.readPos = fVisData->getWritePos();
+            }
+        }
+
+        return level != -1;
+    }
+
+    VisualizationStream* getStream(Client client)
+    {
+        StreamMap::iterator it = fStreams.find(client);
+
+        if (it == fStreams.end()) {
+            if ((getServer() == nullptr) || (getServer()->getClientRole(client) == kClientRoleWebView)) {
+                return nullptr;
+            }
+
+            it = fStreams.emplace(client, VisualizationStream(fVisData->getWritePos())).first;
+        }
+
+        return &it->second;
+    }
+
+    void updateStreams()
+    {
+        // Follow connects and disconnects, and adapt rates to link conditions
+        if (getServer() == nullptr) {
+            return;
+        }
+
+        const ClientInfoVector info = getServer()->getClientInfo(getInstance());
+        StreamMap streams;
+
+        for (ClientInfoVector::const_iterator it = info.cbegin(); it != info.cend(); ++it) {
+            if (it->role == kClientRoleWebView) {
+                continue; // served at kFrequencyLocal
+            }
+
+            StreamMap::iterator sit = fStreams.find(it->client);
+            VisualizationStream stream = sit != fStreams.end() ? sit->second
+                                            : VisualizationStream(fVisData->getWritePos());
+            stream.update(it->queueDepth, it->stats.rtt);
+            streams.emplace(it->client, stream);
+        }
+
+        fStreams.swap(streams);
+    }
+
     VisualizationData* fVisData;
+    PeakPyramid*       fPeaks;
+    SampleVector       fSamples;
+    PeakVector         fPeakBuffer;
+    SpectrumInput*     fSpectrumInput;
+    SpectrumAnalyzer   fSpectrum;
+    SpectrumVector     fSpectrumBins;
+    size_t             fSpectrumBinsLocal;
+    size_t             fReadPosLocal;
+    double             fSendTimeLocal;
+    double             fStreamUpdateTime;
+    StreamMap          fStreams;
 
 };
 
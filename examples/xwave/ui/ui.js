@@ -19,9 +19,11 @@
 import '/dpf.js';
 import { WaveformElement } from '/thirdparty/x-waveform.js'
 
-const NETWORK_REFRESH_FREQ = 10; /*kFrequencyNetwork*/
+const MIN_REFRESH_FREQ     = 2;  /*kFrequencyNetworkMin*/
 const DISPLAY_NUM_BINS     = 8;
 const DISPLAY_SCALE_X      = 0.25;
+const SPECTRUM_NUM_BINS    = 64; /*kSpectrumMinBins-kSpectrumMaxBins*/
+const REPORT_INTERVAL_MS   = 1000;
 
 const env = DISTRHO.env, uiHelper = DISTRHO.UIHelper;
 
@@ -36,7 +38,11 @@ class XWaveExampleUI extends DISTRHO.UI {
 
         this._sampleRate = 0;
         this._sampleBuffer = [];
+        this._decimation = 1;
         this._prevFrameTimeMs = 0;
+        this._frameRate = 0;
+        this._reportTimeMs = 0;
+        this._reportedFrameRate = 0;
 
         this._initView();
     }
@@ -51,12 +57,37 @@ class XWaveExampleUI extends DISTRHO.UI {
         if (this._prevFrameTimeMs == 0) {
             this._startVisualization();
         }
+
+        this.call('setSpectrumResolution', SPECTRUM_NUM_BINS);
     }
 
     onVisualizationData(data) {
+        this._decimation = data.decimation || 1;
         this._addSamples(data.samples.buffer);
     }
 
+    onVisualizationPeaks(data) {
+        // Peak magnitudes, same scale as samples
+        this._decimation = data.framesPerPeak;
+        this._addSamples(data.peaks.buffer);
+    }
+
+    onSpectrumData(data) {
+        // Log spaced bins from minFrequency to Nyquist, minDb (0) to 0 dB (255)
+        const bins = data.bins.buffer,
+              canvas = this._spectrum,
+              ctx = canvas.getContext('2d'),
+              barWidth = canvas.width / bins.length;
+
+        ctx.clearRect(0, 0, canvas.width, canvas.height);
+        ctx.fillStyle = 'rgba(255, 255, 255, 0.2)';
+
+        for (let i = 0; i < bins.length; i++) {
+            const barHeight = canvas.height * bins[i] / 255;
+            ctx.fillRect(i * barWidth, canvas.height - barHeight, Math.max(1, barWidth - 1), barHeight);
+        }
+    }
+
     _initView() {
         if (env.plugin) {
             const qrButton = uiHelper.getNetworkDetailsModalButton(this, {
@@ -69,12 +100,20 @@ class XWaveExampleUI extends DISTRHO.UI {
             document.body.appendChild(qrButton);
         } else {
             uiHelper.enableOfflineModal(this);
+
+            // Let the plugin pause the stream while the page is not visible
+            document.addEventListener('visibilitychange', () => {
+                this._reportClientState();
+            });
         }
 
         window.customElements.define('x-waveform', WaveformElement);
         this._waveform.setAttribute('width', this._waveform.clientWidth 
                                         * DISPLAY_SCALE_X);
 
+        this._spectrum.width = this._spectrum.clientWidth;
+        this._spectrum.height = this._spectrum.clientHeight;
+
         document.body.style.visibility = 'visible';
     }
 
@@ -82,12 +121,19 @@ class XWaveExampleUI extends DISTRHO.UI {
         this._animate(0);
     }
 
+    _reportClientState() {
+        this.call('setVisualizationClientState', this._frameRate, ! document.hidden,
+                  DISPLAY_NUM_BINS);
+        this._reportedFrameRate = this._frameRate;
+    }
+
     _addSamples(/*Uint8Array*/loResSamples) {
-        const maxSize = Math.floor(NETWORK_REFRESH_FREQ / 60 * this._sampleRate),
+        // Keep up to one period of the slowest stream rate
+        const maxSize = Math.floor(this._sampleRate / this._decimation / MIN_REFRESH_FREQ),
               newSize = this._sampleBuffer.length + loResSamples.length;
 
         if (newSize > maxSize) { // avoid buffer overflow
-            this._sampleBuffer.splice(0, maxSize - loResSamples.length);
+            this._sampleBuffer.splice(0, newSize - maxSize);
         }
 
         for (const k of loResSamples) {
@@ -99,10 +145,25 @@ class XWaveExampleUI extends DISTRHO.UI {
         if (this._prevFrameTimeMs > 0) {
             const deltaMs = timestampMs - this._prevFrameTimeMs;
 
-            if (deltaMs > 1000/NETWORK_REFRESH_FREQ) {
+            // Smoothed display refresh rate, reported to the plugin so it can
+            // match the stream rate. Only network clients are rate controlled.
+            if (deltaMs > 0) {
+                const fps = 1000 / deltaMs;
+                this._frameRate = this._frameRate == 0 ? fps : 0.9 * this._frameRate + 0.1 * fps;
+            }
+
+            if (! env.plugin && (timestampMs - this._reportTimeMs) > REPORT_INTERVAL_MS) {
+                this._reportTimeMs = timestampMs;
+
+                if (Math.abs(this._frameRate - this._reportedFrameRate) > 0.1 * this._frameRate) {
+                    this._reportClientState();
+                }
+            }
+
+            if (deltaMs > 1000/MIN_REFRESH_FREQ) {
                 this._sampleBuffer = []; // animation could have been paused
             } else {
-                const numSamples = Math.floor(deltaMs / 1000 * this._sampleRate),
+                const numSamples = Math.floor(deltaMs / 1000 * this._sampleRate / this._decimation),
                       binSize = Math.floor(numSamples / DISPLAY_NUM_BINS),
                       bins = new Float32Array(DISPLAY_NUM_BINS);
 
@@ -136,6 +197,10 @@ class XWaveExampleUI extends DISTRHO.UI {
         return document.querySelector('x-waveform');
     }
 
+    get _spectrum() {
+        return document.getElementById('spectrum');
+    }
+
 }
 
 main();
@@ -18,7 +18,38 @@
 
 #include "WebUI.hpp"
 
-UI* DISTRHO::createUI()
+START_NAMESPACE_DISTRHO
+
+class ZCompExampleUI : public WebUI
 {
-    return new WebUI(640 /*width*/, 128 /*height*/, "#8c8c8c" /*background*/);
+public:
+    ZCompExampleUI()
+        : WebUI(640 /*width*/, 128 /*height*/, "#8c8c8c" /*background*/)
+    {
+#if defined(DPF_WEBUI_NETWORK_UI)
+        // Knob drags from one client reach the others in steps of 0.5% of the
+        // range, host automation is always sent in full. Indexes and ranges
+        // match ZamCompX2Plugin::initParameter().
+        setParameterEchoResolution(0 /*attack*/, 0.1f, 100.f);
+        setParameterEchoResolution(1 /*release*/, 1.f, 500.f);
+        setParameterEchoResolution(2 /*knee*/, 0.f, 8.f);
+        setParameterEchoResolution(3 /*ratio*/, 1.f, 20.f);
+        setParameterEchoResolution(4 /*threshold*/, -80.f, 0.f);
+        setParameterEchoResolution(5 /*makeup*/, 0.f, 30.f);
+        setParameterEchoResolution(6 /*slew*/, 1.f, 150.f);
+#endif
+    }
+
+    ~ZCompExampleUI() {}
+
+private:
+    DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ZCompExampleUI)
+
+};
+
+UI* createUI()
+{
+    return new ZCompExampleUI;
 }
+
+END_NAMESPACE_DISTRHO
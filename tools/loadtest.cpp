@@ -0,0 +1,935 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2021-2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Load generator for NetworkUI. Opens many WebSocket connections to a running
+// plugin instance and drives parameter, state and broadcast traffic through
+// them, then reports throughput, latency and the server figures published at
+// /stats. Latency is measured with the built-in ping function (round trip)
+// and with timestamped broadcasts (one way, all clients share a clock).
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libwebsockets.h"
+
+#define LWS_PROTOCOL_NAME "lws-dpf"
+#define TICK_US           10000
+#define CONNECT_TIMEOUT_S 10.0
+#define PING_TIMEOUT_S    5.0
+#define BROADCAST_TAG     "loadtest"
+
+enum TrafficType
+{
+    kTrafficParameter = 1,
+    kTrafficState     = 2,
+    kTrafficBroadcast = 4
+};
+
+struct Options
+{
+    Options()
+        : host("127.0.0.1")
+        , port(0)
+        , instance(1)
+        , clients(100)
+        , rate(10)
+        , duration(10)
+        , payload(64)
+        , bson(false)
+        , traffic(kTrafficParameter)
+        , parameters(1)
+        , pingInterval(1)
+    {}
+
+    std::string host;
+    int         port;
+    int         instance;
+    int         clients;
+    double      rate;         // messages per second per client, not counting pings
+    double      duration;     // seconds
+    int         payload;      // state value and broadcast padding size in bytes
+    bool        bson;         // must match DPF_WEBUI_PROTOCOL_BINARY of the plugin
+    int         traffic;      // TrafficType flags
+    int         parameters;   // setParameterValue cycles through indexes 0..parameters-1
+    std::string stateKey;     // required for state traffic, must be a plugin state
+    double      pingInterval; // seconds
+};
+
+struct Client
+{
+    Client()
+        : id(0)
+        , wsi(nullptr)
+        , connected(false)
+        , failed(false)
+        , closed(false)
+        , credit(0)
+        , nextTraffic(0)
+        , seq(0)
+        , nextPingTime(0)
+        , pingTime(0)
+    {}
+
+    int         id;
+    lws*        wsi;
+    bool        connected;
+    bool        failed;
+    bool        closed;
+    double      credit;       // messages owed to the configured rate
+    int         nextTraffic;
+    uint32_t    seq;
+    double      nextPingTime;
+    double      pingTime;     // 0 if no ping in flight
+    std::string rx;           // fragments of the message being received
+};
+
+struct Counters
+{
+    Counters()
+        : messagesSent(0)
+        , messagesReceived(0)
+        , bytesSent(0)
+        , bytesReceived(0)
+        , pingsLost(0)
+        , disconnects(0)
+    {}
+
+    uint64_t messagesSent;
+    uint64_t messagesReceived;
+    uint64_t bytesSent;
+    uint64_t bytesReceived;
+    uint64_t pingsLost;
+    uint64_t disconnects;
+};
+
+struct ServerStats
+{
+    ServerStats()
+        : valid(false)
+        , cpuLoad(-1)
+        , peakResidentSize(-1)
+        , messagesDropped(0)
+    {}
+
+    bool   valid;
+    double cpuLoad;
+    double peakResidentSize;
+    double messagesDropped;
+};
+
+enum Phase
+{
+    kPhaseConnecting,
+    kPhaseRunning,
+    kPhaseClosing,
+    kPhaseDone
+};
+
+static Options             gOptions;
+static lws_context*        gContext = nullptr;
+static std::vector<Client> gClients;
+static Counters            gCounters;
+static std::vector<double> gRttMs;
+static std::vector<double> gBroadcastMs;
+static Phase               gPhase = kPhaseConnecting;
+static double              gPhaseTime = 0;
+static double              gLastTickTime = 0;
+static int                 gConnected = 0; // at the end of the run
+static volatile sig_atomic_t gInterrupted = 0;
+
+static double getTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+static int32_t djb2hash(const char* str)
+{
+    int32_t h = 5381;
+    int32_t c;
+
+    while ((c = *str++)) {
+         h = h * 33 ^ c;
+    }
+
+    return h;
+}
+
+// Minimal encoder for the messages sent by this tool. Messages are arrays,
+// in the binary protocol a BSON document keyed "0", "1"... with the function
+// name replaced by its hash, same as dpf.js does.
+
+class MessageWriter
+{
+public:
+    MessageWriter(bool bson)
+        : fBson(bson)
+        , fIndex(0)
+    {
+        if (fBson) {
+            fBuffer.assign(4, 0);
+        } else {
+            fBuffer.push_back('[');
+        }
+    }
+
+    void addFunction(const char* name)
+    {
+        if (fBson) {
+            addInt32(djb2hash(name));
+        } else {
+            addString(name);
+        }
+    }
+
+    void addInt32(int32_t i)
+    {
+        if (fBson) {
+            beginElement(0x10);
+            appendLE(static_cast<uint32_t>(i), 4);
+        } else {
+            beginElement(0);
+            appendText(std::to_string(i).c_str());
+        }
+    }
+
+    void addNumber(double d)
+    {
+        if (fBson) {
+            beginElement(0x01);
+            uint64_t bits;
+            std::memcpy(&bits, &d, sizeof(bits));
+            appendLE(bits, 8);
+        } else {
+            char s[32];
+            std::snprintf(s, sizeof(s), "%.17g", d);
+            beginElement(0);
+            appendText(s);
+        }
+    }
+
+    void addString(const std::string& s)
+    {
+        if (fBson) {
+            beginElement(0x02);
+            appendLE(static_cast<uint32_t>(s.size() + 1), 4);
+            appendText(s.c_str());
+            fBuffer.push_back(0);
+        } else {
+            beginElement(0);
+            fBuffer.push_back('"');
+            for (size_t i = 0; i < s.size(); ++i) {
+                if ((s[i] == '"') || (s[i] == '\\')) {
+                    fBuffer.push_back('\\');
+                }
+                fBuffer.push_back(static_cast<uint8_t>(s[i]));
+            }
+            fBuffer.push_back('"');
+        }
+    }
+
+    // Returns the encoded message preceded by LWS_PRE bytes of headroom
+    std::vector<uint8_t> finish()
+    {
+        if (fBson) {
+            fBuffer.push_back(0);
+            const uint32_t size = static_cast<uint32_t>(fBuffer.size());
+            for (int i = 0; i < 4; ++i) {
+                fBuffer[i] = static_cast<uint8_t>(size >> (8 * i));
+            }
+        } else {
+            fBuffer.push_back(']');
+        }
+
+        std::vector<uint8_t> message(LWS_PRE);
+        message.insert(message.end(), fBuffer.cbegin(), fBuffer.cend());
+
+        return message;
+    }
+
+private:
+    void beginElement(uint8_t type)
+    {
+        if (fBson) {
+            fBuffer.push_back(type);
+            appendText(std::to_string(fIndex).c_str());
+            fBuffer.push_back(0);
+        } else if (fIndex > 0) {
+            fBuffer.push_back(',');
+        }
+
+        fIndex++;
+    }
+
+    void appendLE(uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i) {
+            fBuffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void appendText(const char* s)
+    {
+        fBuffer.insert(fBuffer.end(), s, s + std::strlen(s));
+    }
+
+    bool                 fBson;
+    int                  fIndex;
+    std::vector<uint8_t> fBuffer;
+};
+
+// Reads the function and leading scalar arguments of a received message,
+// anything else is only counted
+
+struct Message
+{
+    Message()
+        : hash(0)
+        , numbers{ 0, 0 }
+    {}
+
+    std::string function; // JSON protocol
+    int32_t     hash;     // binary protocol
+    std::string tag;      // first string argument
+    double      numbers[2];
+};
+
+static bool readBsonMessage(const uint8_t* data, size_t size, Message& msg)
+{
+    if (size < 5) {
+        return false;
+    }
+
+    size_t pos = 4;
+    int index = 0;
+    int numbers = 0;
+
+    while ((pos < size) && (data[pos] != 0) && (index < 4)) {
+        const uint8_t type = data[pos++];
+        const void* key = std::memchr(data + pos, 0, size - pos);
+        if (key == nullptr) {
+            return false;
+        }
+        pos = static_cast<const uint8_t*>(key) - data + 1;
+
+        size_t len;
+        switch (type) {
+            case 0x01: len = 8; break;                 // double
+            case 0x08: len = 1; break;                 // bool
+            case 0x0A: len = 0; break;                 // null
+            case 0x10: len = 4; break;                 // int32
+            case 0x12: len = 8; break;                 // int64
+            case 0x02:                                 // string
+            case 0x03:                                 // document
+            case 0x04:                                 // array
+            case 0x05:                                 // binary
+                if (pos + 4 > size) {
+                    return false;
+                }
+                len = static_cast<size_t>(data[pos]) | (data[pos + 1] << 8)
+                        | (data[pos + 2] << 16) | (static_cast<size_t>(data[pos + 3]) << 24);
+                len += type == 0x02 ? 4 : (type == 0x05 ? 5 : 0);
+                break;
+            default:
+                return true; // not sent by NetworkUI, stop here
+        }
+
+        if (pos + len > size) {
+            return false;
+        }
+
+        if ((index == 0) && (type == 0x10)) {
+            std::memcpy(&msg.hash, data + pos, 4); // little endian hosts only
+        } else if ((type == 0x02) && msg.tag.empty()) {
+            msg.tag.assign(reinterpret_cast<const char*>(data + pos + 4), len - 5);
+        } else if ((type == 0x01) && (numbers < 2)) {
+            std::memcpy(&msg.numbers[numbers++], data + pos, 8);
+        }
+
+        pos += len;
+        index++;
+    }
+
+    return true;
+}
+
+static bool readJsonMessage(const std::string& text, Message& msg)
+{
+    char function[64];
+    char tag[64];
+
+    if (std::sscanf(text.c_str(), "[\"%63[^\"]\"", function) != 1) {
+        return false;
+    }
+
+    msg.function = function;
+
+    if (std::sscanf(text.c_str(), "[\"%*[^\"]\",\"%63[^\"]\",%lf,%lf", tag, &msg.numbers[0],
+                    &msg.numbers[1]) == 3) {
+        msg.tag = tag;
+    }
+
+    return true;
+}
+
+static bool isFunction(const Message& msg, const char* name)
+{
+    return gOptions.bson ? msg.hash == djb2hash(name) : msg.function == name;
+}
+
+static double percentile(std::vector<double>& samples, int p)
+{
+    if (samples.empty()) {
+        return -1;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+
+    return samples[(n * p + 99) / 100 - 1];
+}
+
+static void handleMessage(Client& client, const uint8_t* data, size_t size, double now)
+{
+    Message msg;
+    const bool ok = gOptions.bson ? readBsonMessage(data, size, msg)
+                    : readJsonMessage(std::string(reinterpret_cast<const char*>(data), size), msg);
+    if (! ok) {
+        return;
+    }
+
+    const bool measuring = gPhase == kPhaseRunning;
+
+    if (isFunction(msg, "pong")) {
+        if (client.pingTime > 0) {
+            if (measuring) {
+                gRttMs.push_back(1000.0 * (now - client.pingTime));
+            }
+            client.pingTime = 0;
+        }
+    } else if (isFunction(msg, "messageReceived") && (msg.tag == BROADCAST_TAG)) {
+        if (measuring) {
+            gBroadcastMs.push_back(1000.0 * (now - msg.numbers[1]));
+        }
+    }
+}
+
+static std::vector<uint8_t> createTrafficMessage(Client& client)
+{
+    MessageWriter w(gOptions.bson);
+    int type;
+
+    do {
+        type = 1 << client.nextTraffic;
+        client.nextTraffic = (client.nextTraffic + 1) % 3;
+    } while ((gOptions.traffic & type) == 0);
+
+    const std::string padding(static_cast<size_t>(gOptions.payload), 'x');
+
+    switch (type) {
+        case kTrafficParameter:
+            w.addFunction("setParameterValue");
+            w.addNumber(static_cast<double>(client.seq % static_cast<uint32_t>(gOptions.parameters)));
+            w.addNumber(static_cast<double>(std::rand()) / RAND_MAX);
+            break;
+        case kTrafficState:
+            w.addFunction("setState");
+            w.addString(gOptions.stateKey);
+            w.addString(std::to_string(client.id) + ":" + std::to_string(client.seq) + ":" + padding);
+            break;
+        case kTrafficBroadcast:
+            w.addFunction("broadcast");
+            w.addString(BROADCAST_TAG);
+            w.addNumber(static_cast<double>(client.id));
+            w.addNumber(getTime());
+            w.addString(padding);
+            break;
+    }
+
+    client.seq++;
+
+    return w.finish();
+}
+
+static int sendMessage(Client& client, const std::vector<uint8_t>& message)
+{
+    const size_t size = message.size() - LWS_PRE;
+    unsigned char* data = const_cast<unsigned char*>(message.data()) + LWS_PRE;
+
+    if (lws_write(client.wsi, data, size, gOptions.bson ? LWS_WRITE_BINARY : LWS_WRITE_TEXT)
+            < static_cast<int>(size)) {
+        return -1;
+    }
+
+    if (gPhase == kPhaseRunning) {
+        gCounters.messagesSent++;
+        gCounters.bytesSent += size;
+    }
+
+    return 0;
+}
+
+static int handleWritable(Client& client)
+{
+    if (gPhase >= kPhaseClosing) {
+        return -1;
+    }
+
+    const double now = getTime();
+
+    if ((client.pingTime == 0) && (now >= client.nextPingTime)) {
+        MessageWriter w(gOptions.bson);
+        w.addFunction("ping");
+        client.pingTime = now;
+        client.nextPingTime = now + gOptions.pingInterval;
+        return sendMessage(client, w.finish());
+    }
+
+    if ((gPhase != kPhaseRunning) || (client.credit < 1)) {
+        return 0;
+    }
+
+    client.credit -= 1;
+
+    if (sendMessage(client, createTrafficMessage(client)) != 0) {
+        return -1;
+    }
+
+    if (client.credit >= 1) {
+        lws_callback_on_writable(client.wsi);
+    }
+
+    return 0;
+}
+
+static int callback(lws* wsi, lws_callback_reasons reason, void* user, void* in, size_t len)
+{
+    Client* client = static_cast<Client*>(user);
+
+    switch (reason) {
+        case LWS_CALLBACK_CLIENT_ESTABLISHED:
+            client->connected = true;
+            client->nextPingTime = getTime() + gOptions.pingInterval * std::rand() / RAND_MAX;
+            break;
+        case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+            if (! client->failed) {
+                std::fprintf(stderr, "loadtest : client %d connection error: %s\n", client->id,
+                                in != nullptr ? static_cast<const char*>(in) : "unknown");
+            }
+            client->failed = true;
+            client->wsi = nullptr;
+            break;
+        case LWS_CALLBACK_CLIENT_CLOSED:
+            if (gPhase == kPhaseRunning) {
+                gCounters.disconnects++;
+            }
+            client->closed = true;
+            client->wsi = nullptr;
+            break;
+        case LWS_CALLBACK_CLIENT_RECEIVE: {
+            const double now = getTime();
+            const bool complete = lws_is_final_fragment(wsi) && (lws_remaining_packet_payload(wsi) == 0);
+
+            if (gPhase == kPhaseRunning) {
+                gCounters.bytesReceived += len;
+                gCounters.messagesReceived += complete ? 1 : 0;
+            }
+
+            if (complete && client->rx.empty()) {
+                handleMessage(*client, static_cast<const uint8_t*>(in), len, now);
+            } else {
+                client->rx.append(static_cast<const char*>(in), len);
+                if (complete) {
+                    handleMessage(*client, reinterpret_cast<const uint8_t*>(client->rx.data()),
+                                    client->rx.size(), now);
+                    client->rx.clear();
+                }
+            }
+            break;
+        }
+        case LWS_CALLBACK_CLIENT_WRITEABLE:
+            return handleWritable(*client);
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+// Plain HTTP/1.0 request for /stats, only the "server" figures are read
+static ServerStats fetchServerStats()
+{
+    ServerStats stats;
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* res = nullptr;
+    const std::string port = std::to_string(gOptions.port);
+
+    if (getaddrinfo(gOptions.host.c_str(), port.c_str(), &hints, &res) != 0) {
+        return stats;
+    }
+
+    const int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+
+    if ((fd == -1) || (connect(fd, res->ai_addr, res->ai_addrlen) != 0)) {
+        if (fd != -1) {
+            close(fd);
+        }
+        freeaddrinfo(res);
+        return stats;
+    }
+
+    freeaddrinfo(res);
+
+    timeval tv = { 2, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    const std::string request = "GET /stats HTTP/1.0\r\nHost: " + gOptions.host + "\r\n\r\n";
+    std::string response;
+
+    if (send(fd, request.data(), request.size(), 0) == static_cast<ssize_t>(request.size())) {
+        char buf[4096];
+        ssize_t n;
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+            response.append(buf, static_cast<size_t>(n));
+        }
+    }
+
+    close(fd);
+
+    const size_t server = response.find("{\"server\":");
+    if (server == std::string::npos) {
+        return stats;
+    }
+
+    const char* json = response.c_str() + server;
+    const char* field;
+
+    if ((field = std::strstr(json, "\"cpuLoad\":")) != nullptr) {
+        stats.cpuLoad = std::atof(field + 10);
+    }
+    if ((field = std::strstr(json, "\"peakResidentSize\":")) != nullptr) {
+        stats.peakResidentSize = std::atof(field + 19);
+    }
+    if ((field = std::strstr(json, "\"messagesDropped\":")) != nullptr) {
+        stats.messagesDropped = std::atof(field + 18);
+    }
+
+    stats.valid = true;
+
+    return stats;
+}
+
+static ServerStats gStatsBegin;
+static ServerStats gStatsEnd;
+
+static void setPhase(Phase phase, double now)
+{
+    gPhase = phase;
+    gPhaseTime = now;
+}
+
+static void tick(lws_sorted_usec_list_t* sul)
+{
+    const double now = getTime();
+    const double dt = now - gLastTickTime;
+    gLastTickTime = now;
+
+    int connected = 0;
+    int pending = 0;
+
+    for (Client& client : gClients) {
+        if (client.connected && ! client.closed) {
+            connected++;
+        } else if (! client.failed && ! client.closed) {
+            pending++;
+        }
+    }
+
+    switch (gPhase) {
+        case kPhaseConnecting:
+            if ((pending == 0) || (now - gPhaseTime > CONNECT_TIMEOUT_S) || gInterrupted) {
+                std::fprintf(stderr, "loadtest : %d/%d clients connected\n", connected,
+                                gOptions.clients);
+                gStatsBegin = fetchServerStats();
+                setPhase((connected > 0) && ! gInterrupted ? kPhaseRunning : kPhaseDone, getTime());
+            }
+            break;
+        case kPhaseRunning:
+            if ((now - gPhaseTime >= gOptions.duration) || gInterrupted) {
+                gOptions.duration = now - gPhaseTime;
+                gConnected = connected;
+                gStatsEnd = fetchServerStats();
+                setPhase(kPhaseClosing, now);
+            }
+            break;
+        case kPhaseClosing:
+            if ((connected == 0) || (now - gPhaseTime > CONNECT_TIMEOUT_S)) {
+                setPhase(kPhaseDone, now);
+            }
+            break;
+        case kPhaseDone:
+            return;
+    }
+
+    // Credit is capped to one second worth of messages, a server that cannot
+    // keep up shows as a lower send rate instead of an ever growing backlog
+    for (Client& client : gClients) {
+        if ((client.wsi == nullptr) || ! client.connected) {
+            continue;
+        }
+
+        if ((client.pingTime > 0) && (now - client.pingTime > PING_TIMEOUT_S)) {
+            gCounters.pingsLost += gPhase == kPhaseRunning ? 1 : 0;
+            client.pingTime = 0;
+        }
+
+        if (gPhase == kPhaseRunning) {
+            client.credit = std::min(client.credit + gOptions.rate * dt, std::max(gOptions.rate, 1.0));
+        }
+
+        if ((gPhase == kPhaseClosing) || (client.credit >= 1)
+                || ((client.pingTime == 0) && (now >= client.nextPingTime))) {
+            lws_callback_on_writable(client.wsi);
+        }
+    }
+
+    lws_sul_schedule(gContext, 0, sul, tick, TICK_US);
+}
+
+static void report()
+{
+    const int connected = gConnected;
+    const double duration = gOptions.duration;
+    std::string traffic;
+
+    traffic += gOptions.traffic & kTrafficParameter ? "param " : "";
+    traffic += gOptions.traffic & kTrafficState ? "state " : "";
+    traffic += gOptions.traffic & kTrafficBroadcast ? "broadcast " : "";
+
+    std::printf("clients    %d/%d connected, %d disconnected during the run\n", connected,
+                gOptions.clients, static_cast<int>(gCounters.disconnects));
+    std::printf("run        %.1f s, %s protocol, %.1f msg/s per client: %s\n", duration,
+                gOptions.bson ? "binary" : "JSON", gOptions.rate, traffic.c_str());
+    std::printf("sent       %10.1f msg/s %12.0f B/s\n",
+                static_cast<double>(gCounters.messagesSent) / duration,
+                static_cast<double>(gCounters.bytesSent) / duration);
+    std::printf("received   %10.1f msg/s %12.0f B/s\n",
+                static_cast<double>(gCounters.messagesReceived) / duration,
+                static_cast<double>(gCounters.bytesReceived) / duration);
+    std::printf("rtt        p50 %8.2f ms  p99 %8.2f ms  (%zu samples, %d lost)\n",
+                percentile(gRttMs, 50), percentile(gRttMs, 99), gRttMs.size(),
+                static_cast<int>(gCounters.pingsLost));
+
+    if (gOptions.traffic & kTrafficBroadcast) {
+        std::printf("broadcast  p50 %8.2f ms  p99 %8.2f ms  (%zu deliveries)\n",
+                    percentile(gBroadcastMs, 50), percentile(gBroadcastMs, 99),
+                    gBroadcastMs.size());
+    }
+
+    if (! gStatsBegin.valid || ! gStatsEnd.valid) {
+        std::printf("server     /stats not available, build the plugin with "
+                    "DPF_WEBUI_NETWORK_STATS=true\n");
+        return;
+    }
+
+    const double perClient = connected > 0 ? gStatsEnd.cpuLoad / connected : 0;
+    const double rssGrowth = gStatsEnd.peakResidentSize - gStatsBegin.peakResidentSize;
+
+    std::printf("server     cpu %.1f %% (%.3f %% per client), peak rss growth %.0f KiB, "
+                "%.0f messages dropped\n", gStatsEnd.cpuLoad, perClient, rssGrowth / 1024,
+                gStatsEnd.messagesDropped - gStatsBegin.messagesDropped);
+}
+
+static void usage(const char* argv0)
+{
+    std::fprintf(stderr,
+        "Usage: %s --port PORT [options]\n"
+        "  --host HOST          server address (127.0.0.1)\n"
+        "  --port PORT          server port, see the _ws_port plugin state\n"
+        "  --instance N         plugin instance served at /?instance=N (1)\n"
+        "  --clients N          concurrent WebSocket connections (100)\n"
+        "  --rate R             messages per second per client, excluding pings (10)\n"
+        "  --duration S         measured run time in seconds (10)\n"
+        "  --traffic LIST       comma separated param,state,broadcast (param)\n"
+        "  --parameters N       parameter indexes 0..N-1 used by param traffic (1)\n"
+        "  --state-key KEY      plugin state written by state traffic\n"
+        "  --payload BYTES      state value and broadcast padding size (64)\n"
+        "  --ping-interval S    seconds between pings of each client (1)\n"
+        "  --binary             binary protocol, for plugins built with\n"
+        "                       DPF_WEBUI_PROTOCOL_BINARY\n"
+        "Broadcasts reach every other client, received traffic grows with the\n"
+        "square of the client count.\n", argv0);
+}
+
+static bool parseOptions(int argc, char* argv[])
+{
+    static const option longOptions[] = {
+        { "host"         , required_argument, nullptr, 'h' },
+        { "port"         , required_argument, nullptr, 'p' },
+        { "instance"     , required_argument, nullptr, 'i' },
+        { "clients"      , required_argument, nullptr, 'c' },
+        { "rate"         , required_argument, nullptr, 'r' },
+        { "duration"     , required_argument, nullptr, 'd' },
+        { "traffic"      , required_argument, nullptr, 't' },
+        { "parameters"   , required_argument, nullptr, 'n' },
+        { "state-key"    , required_argument, nullptr, 'k' },
+        { "payload"      , required_argument, nullptr, 's' },
+        { "ping-interval", required_argument, nullptr, 'g' },
+        { "binary"       , no_argument      , nullptr, 'b' },
+        { nullptr        , 0                , nullptr, 0   }
+    };
+
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'h': gOptions.host = optarg; break;
+            case 'p': gOptions.port = std::atoi(optarg); break;
+            case 'i': gOptions.instance = std::atoi(optarg); break;
+            case 'c': gOptions.clients = std::atoi(optarg); break;
+            case 'r': gOptions.rate = std::atof(optarg); break;
+            case 'd': gOptions.duration = std::atof(optarg); break;
+            case 'n': gOptions.parameters = std::atoi(optarg); break;
+            case 'k': gOptions.stateKey = optarg; break;
+            case 's': gOptions.payload = std::atoi(optarg); break;
+            case 'g': gOptions.pingInterval = std::atof(optarg); break;
+            case 'b': gOptions.bson = true; break;
+            case 't': {
+                const std::string list = std::string(",") + optarg + ",";
+                gOptions.traffic = 0;
+                gOptions.traffic |= list.find(",param,") != std::string::npos ? kTrafficParameter : 0;
+                gOptions.traffic |= list.find(",state,") != std::string::npos ? kTrafficState : 0;
+                gOptions.traffic |= list.find(",broadcast,") != std::string::npos ? kTrafficBroadcast : 0;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    if ((gOptions.port <= 0) || (gOptions.clients <= 0) || (gOptions.duration <= 0)
+            || (gOptions.traffic == 0) || (gOptions.parameters <= 0) || (gOptions.payload < 0)
+            || (gOptions.pingInterval <= 0)) {
+        return false;
+    }
+
+    if ((gOptions.traffic & kTrafficState) && gOptions.stateKey.empty()) {
+        std::fprintf(stderr, "loadtest : state traffic needs --state-key\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void handleSignal(int)
+{
+    gInterrupted = 1;
+}
+
+int main(int argc, char* argv[])
+{
+    if (! parseOptions(argc, argv)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::signal(SIGINT, handleSignal);
+    lws_set_log_level(LLL_ERR, nullptr);
+
+    lws_protocols protocols[2];
+    std::memset(protocols, 0, sizeof(protocols));
+    protocols[0].name = LWS_PROTOCOL_NAME;
+    protocols[0].callback = callback;
+    protocols[0].rx_buffer_size = 65536;
+
+    lws_context_creation_info info;
+    std::memset(&info, 0, sizeof(info));
+    info.port = CONTEXT_PORT_NO_LISTEN;
+    info.protocols = protocols;
+    info.fd_limit_per_thread = static_cast<unsigned int>(gOptions.clients + 16);
+
+    gContext = lws_create_context(&info);
+
+    if (gContext == nullptr) {
+        std::fprintf(stderr, "loadtest : could not create lws context\n");
+        return 1;
+    }
+
+    gClients.resize(static_cast<size_t>(gOptions.clients));
+
+    const std::string path = "/?instance=" + std::to_string(gOptions.instance);
+    const std::string host = gOptions.host + ":" + std::to_string(gOptions.port);
+
+    for (size_t i = 0; i < gClients.size(); ++i) {
+        Client& client = gClients[i];
+        client.id = static_cast<int>(i);
+
+        lws_client_connect_info ci;
+        std::memset(&ci, 0, sizeof(ci));
+        ci.context = gContext;
+        ci.address = gOptions.host.c_str();
+        ci.port = gOptions.port;
+        ci.path = path.c_str();
+        ci.host = host.c_str();
+        ci.origin = host.c_str();
+        ci.protocol = LWS_PROTOCOL_NAME;
+        ci.userdata = &client;
+        ci.pwsi = &client.wsi;
+
+        if (lws_client_connect_via_info(&ci) == nullptr) {
+            client.failed = true;
+        }
+    }
+
+    lws_sorted_usec_list_t sul;
+    std::memset(&sul, 0, sizeof(sul));
+    gLastTickTime = getTime();
+    setPhase(kPhaseConnecting, gLastTickTime);
+    lws_sul_schedule(gContext, 0, &sul, tick, TICK_US);
+
+    while ((gPhase != kPhaseDone) && (lws_service(gContext, 0) >= 0)) {}
+
+    lws_context_destroy(gContext);
+
+    if (gCounters.messagesSent == 0) {
+        std::fprintf(stderr, "loadtest : no messages sent\n");
+        return 1;
+    }
+
+    report();
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2021-2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Plugin traits assumed by the WebUIBase sources built into webui-uibench
+
+/**
+   Use BSON instead of JSON, set by the Makefile for webui-uibench-bson
+ */
+#ifndef DPF_WEBUI_PROTOCOL_BINARY
+# define DPF_WEBUI_PROTOCOL_BINARY 0
+#endif
+
+#define DISTRHO_PLUGIN_NAME "UIBench"
+#define DISTRHO_PLUGIN_URI  "https://lucianoiam.com/dpfwebui/uibench"
+
+#define DISTRHO_PLUGIN_NUM_INPUTS  2
+#define DISTRHO_PLUGIN_NUM_OUTPUTS 2
+
+#define DISTRHO_PLUGIN_HAS_UI          1
+#define DISTRHO_PLUGIN_HAS_EXTERNAL_UI 1
+#define DISTRHO_PLUGIN_IS_RT_SAFE      1
+#define DISTRHO_PLUGIN_IS_SYNTH        0
+
+#define DISTRHO_PLUGIN_WANT_MIDI_INPUT  0
+#define DISTRHO_PLUGIN_WANT_MIDI_OUTPUT 0
+#define DISTRHO_PLUGIN_WANT_PROGRAMS    0
+#define DISTRHO_PLUGIN_WANT_STATE       1
+#define DISTRHO_PLUGIN_WANT_FULL_STATE  0
+#define DISTRHO_PLUGIN_WANT_TIMEPOS     0
+
+#define DISTRHO_UI_USE_NANOVG     0
+#define DISTRHO_UI_USER_RESIZABLE 0
@@ -0,0 +1,78 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2021-2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_UI_HPP_INCLUDED
+#define DISTRHO_UI_HPP_INCLUDED
+
+#include <cstdint>
+
+#include "DistrhoPluginInfo.h"
+#include "DistrhoUtils.hpp"
+#include "extra/LeakDetector.hpp"
+
+START_NAMESPACE_DISTRHO
+
+// Headless stand-in for DISTRHO::UI, found before the DPF header because of
+// the include path order. Only the members used by UIEx and WebUIBase are
+// provided, calls towards the host are counted instead of delivered.
+
+class UI
+{
+public:
+    struct HostCalls
+    {
+        uint64_t editParameter;
+        uint64_t setParameterValue;
+        uint64_t setState;
+    };
+
+    UI(uint width = 0, uint height = 0, bool = false)
+        : fWidth(width)
+        , fHeight(height)
+        , fHostCalls()
+    {}
+
+    virtual ~UI() {}
+
+    bool      isStandalone() const noexcept { return true; }
+    uintptr_t getParentWindowHandle() const noexcept { return 0; }
+    double    getSampleRate() const noexcept { return 48000; }
+    uint      getWidth() const noexcept { return fWidth; }
+    uint      getHeight() const noexcept { return fHeight; }
+
+    void editParameter(uint32_t, bool) { fHostCalls.editParameter++; }
+    void setParameterValue(uint32_t, float) { fHostCalls.setParameterValue++; }
+    void setState(const char*, const char*) { fHostCalls.setState++; }
+
+    const HostCalls& getHostCalls() const noexcept { return fHostCalls; }
+
+protected:
+    virtual void parameterChanged(uint32_t index, float value) = 0;
+    virtual void stateChanged(const char*, const char*) {}
+    virtual void sampleRateChanged(double) {}
+    virtual void uiIdle() {}
+
+private:
+    uint      fWidth;
+    uint      fHeight;
+    HostCalls fHostCalls;
+
+    DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(UI)
+};
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_UI_HPP_INCLUDED
@@ -0,0 +1,479 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2021-2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Headless host for the WebUIBase message path. A WebUIBase subclass runs on
+// top of the DistrhoUI.hpp stand-in found in this directory, its postMessage()
+// serializes to the wire format and discards the result. A trace of client
+// messages and host events is replayed and every stage of the message path is
+// timed and checked for heap allocations. No web view, GTK or CEF is needed.
+//
+// Usage: webui-uibench [--repeat N] [trace.jsonl]
+//
+// Traces hold one JSON array per line, lines starting with # are ignored:
+//
+//   ["client", "setParameterValue", 0, 0.5]    message from the web view
+//   ["host", "parameterChanged", 0, 0.5]       UI::parameterChanged()
+//   ["host", "stateChanged", "key", "value"]   UI::stateChanged()
+//   ["idle"]                                   UI::uiIdle()
+//
+// Without a trace a synthetic editing session is replayed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "WebUIBase.hpp"
+#include "AllocStats.hpp"
+#include "extra/JSONVariant.hpp"
+
+USE_NAMESPACE_DISTRHO
+
+// Stands in for a web view or network client pointer
+static const uintptr_t kClientOrigin = 0x1000;
+
+enum Stage
+{
+    kStageDecode,    // wire format to Variant
+    kStageHandle,    // handleMessage() including the function handler
+    kStageIdle,      // uiIdle() running queued blocks
+    kStageCallback,  // host event to postMessage() including serialization
+    kStageEndToEnd,  // client message arrival to the queued host call, allocs
+                     // only counted for the host call itself
+    kStageCount
+};
+
+static const char* const kStageNames[] = { "decode", "handle", "idle", "callback", "end-to-end" };
+
+static int64_t getTimeNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class StageStats
+{
+public:
+    void add(int64_t ns, const AllocCounter& allocs)
+    {
+        const AllocPause allocPause; // sample storage is not part of the stage
+        fSamples.push_back(ns);
+        fAllocCount += allocs.count;
+        fAllocBytes += allocs.bytes;
+    }
+
+    void print(const char* name)
+    {
+        if (fSamples.empty()) {
+            return;
+        }
+
+        std::sort(fSamples.begin(), fSamples.end());
+
+        const size_t n = fSamples.size();
+        const double calls = static_cast<double>(n);
+
+        std::printf("%-12s %8zu %10.2f %10.2f %10.2f %10.2f %12.1f\n", name, n,
+                    percentile(0.5) / 1000.0, percentile(0.99) / 1000.0,
+                    static_cast<double>(fSamples.back()) / 1000.0,
+                    static_cast<double>(fAllocCount) / calls,
+                    static_cast<double>(fAllocBytes) / calls);
+    }
+
+private:
+    double percentile(double p) const
+    {
+        const size_t i = static_cast<size_t>(p * static_cast<double>(fSamples.size() - 1) + 0.5);
+        return static_cast<double>(fSamples[i]);
+    }
+
+    std::vector<int64_t> fSamples;
+    uint64_t fAllocCount = 0;
+    uint64_t fAllocBytes = 0;
+};
+
+static StageStats gStats[kStageCount];
+
+// Times a stage and counts its allocations
+class StageScope
+{
+public:
+    StageScope(Stage stage, int64_t startNs = 0)
+        : fStage(stage)
+        , fStartNs(startNs != 0 ? startNs : getTimeNs())
+    {}
+
+    ~StageScope()
+    {
+        const int64_t ns = getTimeNs() - fStartNs;
+        gStats[fStage].add(ns, fAllocs.get());
+    }
+
+private:
+    const Stage      fStage;
+    const int64_t    fStartNs;
+    const AllocScope fAllocs;
+};
+
+#if DPF_WEBUI_PROTOCOL_BINARY
+typedef BinaryData WireMessage;
+#else
+typedef String WireMessage;
+#endif
+
+class BenchUI : public WebUIBase
+{
+public:
+    BenchUI()
+        : WebUIBase(600, 300, 1.f
+#if DPF_WEBUI_PROTOCOL_BINARY
+            , [](const char* f) { return djb2(f); }
+#endif
+        )
+        , fArrivalNs(0)
+        , fBytesOut(0)
+        , fMessagesOut(0)
+    {
+        // Handlers that reach the host run from uiIdle() like in NetworkUI,
+        // where messages arrive on the server thread
+        const FunctionHandler& parameterHandlerSuper = getFunctionHandler("setParameterValue");
+
+        setFunctionHandler("setParameterValue", 2, [this, parameterHandlerSuper](const Variant& args, uintptr_t origin) {
+            const int64_t arrivalNs = fArrivalNs;
+            queue([parameterHandlerSuper, args, origin, arrivalNs] {
+                const StageScope stage(kStageEndToEnd, arrivalNs);
+                parameterHandlerSuper(args, origin);
+            });
+        });
+
+        const FunctionHandler& stateHandlerSuper = getFunctionHandler("setState");
+
+        setFunctionHandler("setState", 2, [this, stateHandlerSuper](const Variant& args, uintptr_t origin) {
+            const int64_t arrivalNs = fArrivalNs;
+            queue([stateHandlerSuper, args, origin, arrivalNs] {
+                const StageScope stage(kStageEndToEnd, arrivalNs);
+                stateHandlerSuper(args, origin);
+            });
+        });
+    }
+
+    static Variant djb2(const char* name)
+    {
+        int32_t h = 5381;
+        int32_t c;
+
+        while ((c = *name++)) {
+             h = h * 33 ^ c;
+        }
+
+        return Variant(h);
+    }
+
+    void receive(const WireMessage& message)
+    {
+        fArrivalNs = getTimeNs();
+        Variant payload;
+
+        {
+            const StageScope stage(kStageDecode, fArrivalNs);
+#if DPF_WEBUI_PROTOCOL_BINARY
+            payload = BSONVariant::fromBSON(message, /*asArray*/true);
+#else
+            payload = JSONVariant::fromJSON(message.buffer());
+#endif
+        }
+
+        const StageScope stage(kStageHandle);
+        handleMessage(payload, kClientOrigin);
+    }
+
+    void hostParameterChanged(uint32_t index, float value)
+    {
+        const StageScope stage(kStageCallback);
+        parameterChanged(index, value);
+    }
+
+    void hostStateChanged(const char* key, const char* value)
+    {
+        const StageScope stage(kStageCallback);
+        stateChanged(key, value);
+    }
+
+    void idle()
+    {
+        const StageScope stage(kStageIdle);
+        uiIdle();
+    }
+
+    uint64_t getBytesOut() const noexcept { return fBytesOut; }
+    uint64_t getMessagesOut() const noexcept { return fMessagesOut; }
+
+protected:
+    void postMessage(const Variant& payload, uintptr_t, uintptr_t) override
+    {
+#if DPF_WEBUI_PROTOCOL_BINARY
+        const BinaryData data = payload.toBSON();
+        fBytesOut += data.size();
+#else
+        const String json = payload.toJSON();
+        fBytesOut += json.length();
+#endif
+        fMessagesOut++;
+    }
+
+private:
+    int64_t  fArrivalNs;
+    uint64_t fBytesOut;
+    uint64_t fMessagesOut;
+
+};
+
+// Pre-encoded trace entry, wire messages are built before replay so client
+// side serialization is not measured
+struct TraceEvent
+{
+    enum Type { kClient, kHostParameter, kHostState, kIdle };
+
+    Type        type;
+    WireMessage message;
+    uint32_t    index;
+    float       value;
+    std::string key;
+    std::string state;
+};
+
+#if DPF_WEBUI_PROTOCOL_BINARY
+static Variant toVariant(const JSONVariant& json)
+{
+    if (json.isBoolean()) {
+        return Variant(json.getBoolean());
+    } else if (json.isNumber()) {
+        return Variant(json.getNumber());
+    } else if (json.isString()) {
+        return Variant(json.getString());
+    } else if (json.isArray()) {
+        Variant array = Variant::createArray();
+        const int size = json.getArraySize();
+
+        for (int i = 0; i < size; ++i) {
+            array.pushArrayItem(toVariant(json[i]));
+        }
+
+        return array;
+    }
+
+    return Variant(); // objects are not sent by the client library
+}
+#endif
+
+static bool parseEvent(const JSONVariant& entry, TraceEvent& event)
+{
+    const String kind = entry[0].getString();
+
+    if (kind == "idle") {
+        event.type = TraceEvent::kIdle;
+        return true;
+    }
+
+    if (entry.getArraySize() < 2) {
+        return false;
+    }
+
+    const String function = entry[1].getString();
+
+    if (kind == "client") {
+        event.type = TraceEvent::kClient;
+#if DPF_WEBUI_PROTOCOL_BINARY
+        Variant message = toVariant(entry.sliceArray(2));
+        message.insertArrayItem(0, BenchUI::djb2(function));
+        event.message = message.toBSON();
+#else
+        event.message = entry.sliceArray(1).toJSON();
+#endif
+        return true;
+    }
+
+    if ((kind == "host") && (function == "parameterChanged") && (entry.getArraySize() == 4)) {
+        event.type = TraceEvent::kHostParameter;
+        event.index = static_cast<uint32_t>(entry[2].getNumber());
+        event.value = static_cast<float>(entry[3].getNumber());
+        return true;
+    }
+
+    if ((kind == "host") && (function == "stateChanged") && (entry.getArraySize() == 4)) {
+        event.type = TraceEvent::kHostState;
+        event.key = entry[2].getString().buffer();
+        event.state = entry[3].getString().buffer();
+        return true;
+    }
+
+    return false;
+}
+
+static bool loadTrace(const char* path, std::vector<TraceEvent>& events)
+{
+    std::ifstream file(path);
+
+    if (! file) {
+        std::fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+
+    while (std::getline(file, line)) {
+        lineNumber++;
+
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+
+        const JSONVariant entry = JSONVariant::fromJSON(line.c_str());
+        TraceEvent event = TraceEvent();
+
+        if (! entry.isArray() || (entry.getArraySize() == 0) || ! parseEvent(entry, event)) {
+            std::fprintf(stderr, "%s:%d: invalid trace entry\n", path, lineNumber);
+            return false;
+        }
+
+        events.push_back(event);
+    }
+
+    return true;
+}
+
+// A user moving a knob while the plugin automates another parameter, with an
+// occasional preset save and a host frame every four client messages
+static void createSyntheticTrace(std::vector<TraceEvent>& events)
+{
+    const std::string preset(1024, 'p');
+    std::vector<std::string> lines = {
+        "[\"client\", \"getInitWidthCSS\"]",
+        "[\"client\", \"getInitHeightCSS\"]",
+        "[\"client\", \"getSampleRate\"]",
+        "[\"client\", \"isStandalone\"]",
+        "[\"idle\"]"
+    };
+
+    for (int i = 0; i < 256; ++i) {
+        const std::string value = std::to_string(static_cast<double>(i % 100) / 100.0);
+
+        lines.push_back("[\"client\", \"editParameter\", 0, true]");
+
+        for (int j = 0; j < 4; ++j) {
+            lines.push_back("[\"client\", \"setParameterValue\", 0, " + value + "]");
+            lines.push_back("[\"host\", \"parameterChanged\", 1, " + value + "]");
+        }
+
+        lines.push_back("[\"client\", \"editParameter\", 0, false]");
+
+        if ((i % 16) == 0) {
+            lines.push_back("[\"client\", \"setState\", \"preset\", \"" + preset + "\"]");
+            lines.push_back("[\"host\", \"stateChanged\", \"preset\", \"" + preset + "\"]");
+        }
+
+        lines.push_back("[\"idle\"]");
+    }
+
+    for (size_t i = 0; i < lines.size(); ++i) {
+        TraceEvent event = TraceEvent();
+        parseEvent(JSONVariant::fromJSON(lines[i].c_str()), event);
+        events.push_back(event);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* tracePath = nullptr;
+    int repeat = 100;
+
+    for (int i = 1; i < argc; ++i) {
+        if ((std::strcmp(argv[i], "--repeat") == 0) && (i + 1 < argc)) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (argv[i][0] != '-') {
+            tracePath = argv[i];
+        } else {
+            std::fprintf(stderr, "Usage: %s [--repeat N] [trace.jsonl]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<TraceEvent> events;
+
+    if (tracePath != nullptr) {
+        if (! loadTrace(tracePath, events)) {
+            return 1;
+        }
+    } else {
+        createSyntheticTrace(events);
+    }
+
+    BenchUI ui;
+    uint64_t bytesIn = 0;
+
+    for (int r = 0; r < repeat; ++r) {
+        for (std::vector<TraceEvent>::const_iterator it = events.cbegin(); it != events.cend(); ++it) {
+            switch (it->type) {
+                case TraceEvent::kClient:
+#if DPF_WEBUI_PROTOCOL_BINARY
+                    bytesIn += it->message.size();
+#else
+                    bytesIn += it->message.length();
+#endif
+                    ui.receive(it->message);
+                    break;
+                case TraceEvent::kHostParameter:
+                    ui.hostParameterChanged(it->index, it->value);
+                    break;
+                case TraceEvent::kHostState:
+                    ui.hostStateChanged(it->key.c_str(), it->state.c_str());
+                    break;
+                case TraceEvent::kIdle:
+                    ui.idle();
+                    break;
+            }
+        }
+    }
+
+    ui.idle(); // drain blocks queued after the last idle entry
+
+    std::printf("protocol %s, %zu events x %d\n\n", DPF_WEBUI_PROTOCOL_BINARY ? "BSON" : "JSON",
+                events.size(), repeat);
+    std::printf("%-12s %8s %10s %10s %10s %10s %12s\n", "stage", "calls", "p50 us", "p99 us",
+                "max us", "allocs", "bytes");
+
+    for (int i = 0; i < kStageCount; ++i) {
+        gStats[i].print(kStageNames[i]);
+    }
+
+    const UI::HostCalls& hostCalls = ui.getHostCalls();
+
+    std::printf("\nwire in %llu bytes, out %llu bytes in %llu messages\n",
+                static_cast<unsigned long long>(bytesIn),
+                static_cast<unsigned long long>(ui.getBytesOut()),
+                static_cast<unsigned long long>(ui.getMessagesOut()));
+    std::printf("host calls: setParameterValue %llu, setState %llu, editParameter %llu\n",
+                static_cast<unsigned long long>(hostCalls.setParameterValue),
+                static_cast<unsigned long long>(hostCalls.setState),
+                static_cast<unsigned long long>(hostCalls.editParameter));
+
+    return 0;
+}
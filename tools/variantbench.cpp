@@ -0,0 +1,237 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2021-2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Microbenchmarks for the Variant backends. Every operation on the message
+// path is timed on payloads shaped like real traffic: parameter changes,
+// state blobs and visualization frames. Pass a substring to only run the
+// matching benchmarks, e.g. "webui-variantbench BSON/state".
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "extra/JSONVariant.hpp"
+#if defined(DPF_WEBUI_SUPPORT_BSON)
+# include "extra/BSONVariant.hpp"
+#endif
+
+USE_NAMESPACE_DISTRHO
+
+#define MIN_TIME_S 0.25
+
+static const char* gFilter = nullptr;
+
+template <class T>
+static inline void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+// Repeats f until the batch takes MIN_TIME_S, then reports time per call
+template <class F>
+static void run(const char* backend, const char* payload, const char* op, F f)
+{
+    const std::string name = std::string(backend) + "/" + payload + "/" + op;
+
+    if ((gFilter != nullptr) && (name.find(gFilter) == std::string::npos)) {
+        return;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    size_t iterations = 1;
+    double elapsed;
+
+    while (true) {
+        const Clock::time_point start = Clock::now();
+
+        for (size_t i = 0; i < iterations; ++i) {
+            f();
+        }
+
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (elapsed >= MIN_TIME_S) {
+            break;
+        }
+
+        iterations *= elapsed < MIN_TIME_S / 10 ? 10 : 2;
+    }
+
+    std::printf("%-44s %12.1f ns %12zu\n", name.c_str(), 1e9 * elapsed / iterations, iterations);
+}
+
+// Function names are hashed in the binary protocol, see WebUIBase
+template <class V>
+static V functionArgument(const char* name);
+
+template <>
+JSONVariant functionArgument<JSONVariant>(const char* name)
+{
+    return JSONVariant(name);
+}
+
+#if defined(DPF_WEBUI_SUPPORT_BSON)
+template <>
+BSONVariant functionArgument<BSONVariant>(const char* name)
+{
+    int32_t h = 5381;
+    int32_t c;
+
+    while ((c = *name++)) {
+         h = h * 33 ^ c;
+    }
+
+    return BSONVariant(h);
+}
+#endif
+
+template <class V>
+static V createParameterMessage()
+{
+    V msg = { 3, 0.75f };
+    msg.insertArrayItem(0, functionArgument<V>("parameterChanged"));
+    return msg;
+}
+
+template <class V>
+static V createStateMessage(const String& blob)
+{
+    V msg = { "preset", blob };
+    msg.insertArrayItem(0, functionArgument<V>("stateChanged"));
+    return msg;
+}
+
+template <class V>
+static V createFrameMessage(const BinaryData& frame)
+{
+    V msg = { frame, 512.0 };
+    msg.insertArrayItem(0, functionArgument<V>("onVisualizationData"));
+    return msg;
+}
+
+// Operations performed by WebUIBase::callback() and handleMessage()
+template <class V>
+static void runCommon(const char* backend, const char* payload, const V& msg)
+{
+    run(backend, payload, "copy", [&msg] {
+        const V copy = msg;
+        doNotOptimize(copy);
+    });
+
+    run(backend, payload, "operator[]", [&msg] {
+        const V item = msg[1];
+        doNotOptimize(item);
+    });
+
+    run(backend, payload, "getArraySize", [&msg] {
+        const int size = msg.getArraySize();
+        doNotOptimize(size);
+    });
+
+    run(backend, payload, "sliceArray", [&msg] {
+        const V args = msg.sliceArray(1);
+        doNotOptimize(args);
+    });
+
+    const V args = msg.sliceArray(1);
+    const V function = msg[0];
+
+    run(backend, payload, "insertArrayItem", [&args, &function] {
+        V copy = args;
+        copy.insertArrayItem(0, function);
+        doNotOptimize(copy);
+    });
+
+    run(backend, payload, "toJSON", [&msg] {
+        const String json = msg.toJSON();
+        doNotOptimize(json);
+    });
+
+    const String json = msg.toJSON();
+
+    run(backend, payload, "fromJSON", [&json] {
+        const V parsed = V::fromJSON(json.buffer());
+        doNotOptimize(parsed);
+    });
+}
+
+template <class V>
+static void runBackend(const char* backend, const String& blob, const BinaryData& frame)
+{
+    run(backend, "parameter", "construct", [] {
+        const V msg = createParameterMessage<V>();
+        doNotOptimize(msg);
+    });
+
+    run(backend, "state", "construct", [&blob] {
+        const V msg = createStateMessage<V>(blob);
+        doNotOptimize(msg);
+    });
+
+    run(backend, "frame", "construct", [&frame] {
+        const V msg = createFrameMessage<V>(frame);
+        doNotOptimize(msg);
+    });
+
+    runCommon(backend, "parameter", createParameterMessage<V>());
+    runCommon(backend, "state", createStateMessage<V>(blob));
+    runCommon(backend, "frame", createFrameMessage<V>(frame));
+}
+
+#if defined(DPF_WEBUI_SUPPORT_BSON)
+static void runBSONWire(const char* payload, const BSONVariant& msg)
+{
+    run("BSON", payload, "toBSON", [&msg] {
+        const BinaryData data = msg.toBSON();
+        doNotOptimize(data);
+    });
+
+    const BinaryData data = msg.toBSON();
+
+    run("BSON", payload, "fromBSON", [&data] {
+        const BSONVariant parsed = BSONVariant::fromBSON(data, /*asArray*/true);
+        doNotOptimize(parsed);
+    });
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1) {
+        gFilter = argv[1];
+    }
+
+    // 4 KiB preset and a 1024 point 8-bit visualization frame
+    const String blob(std::string(4096, 'x').c_str());
+    BinaryData frame(1024);
+
+    for (size_t i = 0; i < frame.size(); ++i) {
+        frame[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    std::printf("%-44s %15s %12s\n", "benchmark", "time", "iterations");
+
+    runBackend<JSONVariant>("JSON", blob, frame);
+#if defined(DPF_WEBUI_SUPPORT_BSON)
+    runBackend<BSONVariant>("BSON", blob, frame);
+    runBSONWire("parameter", createParameterMessage<BSONVariant>());
+    runBSONWire("state", createStateMessage<BSONVariant>(blob));
+    runBSONWire("frame", createFrameMessage<BSONVariant>(frame));
+#endif
+
+    return 0;
+}
@@ -83,15 +83,8 @@ public:
     void insertArrayItem(int idx, const BSONVariant& var) noexcept;
     void setObjectItem(const char* key, const BSONVariant& var) noexcept;
 
-    BSONVariant sliceArray(int start, int end = -1) const noexcept
-    {
-        return ::sliceVariantArray(*this, start, end);
-    }
-
-    BSONVariant& operator+=(const BSONVariant& other) noexcept
-    {
-        return ::joinVariantArrays(*this, other);
-    }
+    BSONVariant  sliceArray(int start, int end = -1) const noexcept;
+    BSONVariant& operator+=(const BSONVariant& other) noexcept;
 
     friend BSONVariant operator+(BSONVariant lhs, const BSONVariant& rhs) noexcept
     {
@@ -112,6 +105,19 @@ public:
 private:
     BSONVariant(bson_type_t type, bson_t* array) noexcept;
 
+    // Formats array keys without allocating, libbson caches the small ones
+    struct ArrayKey
+    {
+        const char* get(int idx) noexcept
+        {
+            const char* key;
+            bson_uint32_to_string(static_cast<uint32_t>(idx), &key, fBuffer, sizeof(fBuffer));
+            return key;
+        }
+
+        char fBuffer[16];
+    };
+
     void copy(const BSONVariant& var) noexcept;
     void move(BSONVariant&& var) noexcept;
     void destroy() noexcept;
@@ -120,6 +126,7 @@ private:
     static void        set(bson_t* bson, const char* key, const BSONVariant& var) noexcept;
 
     bson_type_t fType;
+    int         fCount; // keys in fDocument, bson_count_keys() walks the document
 
     union {
         bool        fBool;
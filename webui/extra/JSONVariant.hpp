@@ -80,15 +80,8 @@ public:
     void insertArrayItem(int idx, const JSONVariant& var) noexcept;
     void setObjectItem(const char* key, const JSONVariant& var) noexcept;
 
-    JSONVariant sliceArray(int start, int end = -1) const noexcept
-    {
-        return ::sliceVariantArray(*this, start, end);
-    }
-
-    JSONVariant& operator+=(const JSONVariant& other) noexcept
-    {
-        return ::joinVariantArrays(*this, other);
-    }
+    JSONVariant  sliceArray(int start, int end = -1) const noexcept;
+    JSONVariant& operator+=(const JSONVariant& other) noexcept;
 
     friend JSONVariant operator+(JSONVariant lhs, const JSONVariant& rhs) noexcept
     {
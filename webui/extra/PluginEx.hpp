@@ -18,6 +18,8 @@
 #define PLUGIN_EX_HPP
 
 #include <map>
+#include <utility>
+#include <vector>
 
 #include "DistrhoPlugin.hpp"
 
@@ -26,6 +28,7 @@
 #  error Shared memory support requires DISTRHO_PLUGIN_WANT_STATE
 # endif
 # include "extra/SharedMemory.hpp"
+# include "extra/SharedMemoryHeader.hpp"
 #endif 
 
 START_NAMESPACE_DISTRHO
@@ -36,7 +39,7 @@ class PluginEx : public Plugin
 {
 public:
     PluginEx(uint32_t parameterCount, uint32_t programCount, uint32_t stateCount);
-    virtual ~PluginEx() {}
+    virtual ~PluginEx();
 
 #if DISTRHO_PLUGIN_WANT_STATE
     void   initState(uint32_t index, State& state) override;
@@ -54,10 +57,23 @@ public:
 #if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
     uint8_t* getSharedMemoryPointer() const noexcept;
     bool     writeSharedMemory(const uint8_t* data, size_t size, size_t offset = 0) const noexcept;
+
+    // Named regions within the shared memory, see UIEx. Not for the audio
+    // thread, look regions up in sharedMemoryConnected() and keep pointers.
+    uint8_t* createSharedMemoryRegion(const char* name, size_t size) noexcept;
+    uint8_t* getSharedMemoryRegion(const char* name, size_t* size = nullptr) const noexcept;
+    uint8_t* resizeSharedMemoryRegion(const char* name, size_t size) noexcept;
+    bool     removeSharedMemoryRegion(const char* name) noexcept;
+    uint32_t getSharedMemoryRegionsVersion() const noexcept;
 #endif
 
 protected:
 #if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
+    // Call from run() to receive UI writes through sharedMemoryWritten() on
+    // the audio thread. Until the first call, and whenever the queue is full,
+    // writes are notified from the thread that handles plugin state instead.
+    void processSharedMemoryCommands() noexcept;
+
     virtual void sharedMemoryWillDisconnect() {}
     virtual void sharedMemoryConnected(uint8_t* ptr)
     {
@@ -73,13 +89,25 @@ protected:
 #endif
 
 private:
+#if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
+    void disconnectSharedMemory();
+    void unmapRetiredSharedMemory();
+#endif
+
 #if defined(DPF_WEBUI_NETWORK_UI)
     uint32_t fStateIndexWsPort;
 #endif
 #if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
     uint32_t fStateIndexShMemFile;
     uint32_t fStateIndexShMemData;
-    SharedMemory<uint8_t,DPF_WEBUI_SHARED_MEMORY_SIZE> fMemory;
+    typedef SharedMemory<uint8_t,kSharedMemoryDataOffset + DPF_WEBUI_SHARED_MEMORY_SIZE> PluginSharedMemory;
+    typedef std::pair<PluginSharedMemory*,uint32_t> RetiredSharedMemory; // epoch at retirement
+
+    PluginSharedMemory*              fMemory;
+    std::vector<RetiredSharedMemory> fRetiredMemory;
+    std::atomic<SharedMemoryHeader*> fMemoryHeader;
+    std::atomic<uint32_t>            fMemoryEpoch; // odd while run() drains commands
+    std::atomic<uint8_t*>            fMemoryData;
 #endif
 #if DPF_WEBUI_ZEROCONF
     uint32_t fStateIndexZeroconfPublish;
@@ -25,18 +25,43 @@
 # include <windows.h>
 #else
 # include <cerrno>
+# include <cstdio>
 # include <fcntl.h>
 # include <unistd.h>
 # include <sys/mman.h>
+# include <sys/stat.h>
 # ifndef MAP_LOCKED
 #  define MAP_LOCKED 0x0
 # endif
+# ifndef MAP_POPULATE
+#  define MAP_POPULATE 0x0
+# endif
+# if defined(DISTRHO_OS_LINUX) && defined(MFD_HUGETLB)
+#  define DISTRHO_SHARED_MEMORY_MEMFD
+# endif
 #endif
 
+#include <atomic>
 #include <ctime>
+#include <random>
+#include <type_traits>
 
 START_NAMESPACE_DISTRHO
 
+// -----------------------------------------------------------------------
+// Options for SharedMemory::create() and connect(), ignored where unsupported.
+// Anonymous segments are memfd files reachable through /proc/<pid>/fd/<fd>,
+// other processes need to run as the same user and see the creator procfs.
+// Huge pages require pages reserved by the system (vm.nr_hugepages), the
+// segment falls back to regular pages otherwise.
+
+enum SharedMemoryFlags
+{
+    kSharedMemoryAnonymous = 1 << 0,
+    kSharedMemoryHugePages = 1 << 1, // implies kSharedMemoryAnonymous
+    kSharedMemoryPrefault  = 1 << 2  // populate page tables when mapping
+};
+
 // -----------------------------------------------------------------------
 
 template<class S, size_t N>
@@ -49,7 +74,9 @@ public:
 #ifdef DISTRHO_OS_WINDOWS
           map(INVALID_HANDLE_VALUE)
 #else
-          fd(-1)
+          fd(-1),
+          size(0),
+          anonymous(false)
 #endif
     {
     }
@@ -59,10 +86,28 @@ public:
         close();
     }
 
-    bool create()
+    bool create(const uint flags = 0)
     {
         DISTRHO_SAFE_ASSERT_RETURN(ptr == nullptr, false);
 
+#ifdef DISTRHO_SHARED_MEMORY_MEMFD
+        if ((flags & kSharedMemoryHugePages) != 0)
+        {
+            if (createAnonymous(MFD_HUGETLB, flags))
+                return true;
+
+            d_stderr("SharedMemory::create: huge pages not available, using regular pages");
+        }
+
+        if ((flags & (kSharedMemoryAnonymous|kSharedMemoryHugePages)) != 0)
+        {
+            if (createAnonymous(0, flags))
+                return true;
+
+            d_stderr("SharedMemory::create: memfd not available, using named segment");
+        }
+#endif
+
         char filename2[64];
 #ifdef DISTRHO_OS_WINDOWS
         std::sprintf(filename2, "Local\\dpf_XXXXXX");
@@ -72,7 +117,10 @@ public:
 #endif
         const std::size_t filename2len = std::strlen(filename2);
 
-        std::srand(static_cast<uint>(std::time(nullptr)));
+        // Private generator, std::srand() would reset the host rand() sequence
+        // and instances created within the same second would race for names
+        std::minstd_rand random(static_cast<std::minstd_rand::result_type>(std::random_device()()
+                                ^ static_cast<uint>(std::time(nullptr))));
 
         // Step 1. Find a valid shared memory segment (keep trying until one is obtained or an error occurs)
         for (;;)
@@ -85,7 +133,7 @@ public:
 
             // fill the XXXXXX characters randomly
             for (std::size_t c = filename2len - 6; c < filename2len; ++c)
-                filename2[c] = charSet[std::rand() % charSetLen];
+                filename2[c] = charSet[random() % charSetLen];
 
 #ifdef DISTRHO_OS_WINDOWS
             const HANDLE h = ::CreateFileMapping(INVALID_HANDLE_VALUE, nullptr,
@@ -160,6 +208,7 @@ public:
 
         map = map2;
         ptr = (S*)ptr2;
+        (void)flags;
 #else
         int ret;
 
@@ -175,7 +224,7 @@ public:
             return false;
         }
 
-        void* const ptr2 = ::mmap(nullptr, N * sizeof(S), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_LOCKED, fd2, 0);
+        void* const ptr2 = ::mmap(nullptr, N * sizeof(S), PROT_READ|PROT_WRITE, getMapFlags(flags), fd2, 0);
 
         if (ptr2 == nullptr || ptr2 == MAP_FAILED)
         {
@@ -187,13 +236,15 @@ public:
 
         fd = fd2;
         ptr = (S*)ptr2;
+        size = N * sizeof(S);
+        anonymous = false;
 #endif
 
         filename = filename2;
         return true;
     }
 
-    S* connect(const char* const filename2)
+    S* connect(const char* const filename2, const uint flags = 0)
     {
         DISTRHO_SAFE_ASSERT_RETURN(ptr == nullptr, nullptr);
 
@@ -216,20 +267,35 @@ public:
 
         map = map2;
         ptr = (S*)ptr2;
+        (void)flags;
 #else
         int fd2;
 
         try {
-            fd2 = ::shm_open(filename2, O_RDWR, 0);
+            if (std::strncmp(filename2, "/proc/", 6) == 0)
+                fd2 = ::open(filename2, O_RDWR); // anonymous segment
+            else
+                fd2 = ::shm_open(filename2, O_RDWR, 0);
         } DISTRHO_SAFE_EXCEPTION_RETURN("SharedMemory::connect", nullptr);
 
         if (fd2 < 0)
         {
-            d_stderr2("SharedMemory::connect: ftruncate failed: %s", std::strerror(errno));
+            d_stderr2("SharedMemory::connect: open failed: %s", std::strerror(errno));
             return nullptr;
         }
 
-        void* const ptr2 = ::mmap(nullptr, N * sizeof(S), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_LOCKED, fd2, 0);
+        // Huge page segments are larger than requested and must be mapped whole
+        struct stat st;
+
+        if (::fstat(fd2, &st) != 0 || static_cast<std::size_t>(st.st_size) < N * sizeof(S))
+        {
+            d_stderr2("SharedMemory::connect: invalid segment size");
+            ::close(fd2);
+            return nullptr;
+        }
+
+        const std::size_t size2 = static_cast<std::size_t>(st.st_size);
+        void* const ptr2 = ::mmap(nullptr, size2, PROT_READ|PROT_WRITE, getMapFlags(flags), fd2, 0);
 
         if (ptr2 == nullptr || ptr2 == MAP_FAILED)
         {
@@ -240,6 +306,8 @@ public:
 
         fd = fd2;
         ptr = (S*)ptr2;
+        size = size2;
+        anonymous = false;
 #endif
 
         return ptr;
@@ -255,13 +323,14 @@ public:
             map = INVALID_HANDLE_VALUE;
 #else
             try {
-                ::munmap(ptr, N * sizeof(S));
+                ::munmap(ptr, size);
             } DISTRHO_SAFE_EXCEPTION("SharedMemory::close");
 
             try {
                 ::close(fd);
             } DISTRHO_SAFE_EXCEPTION("SharedMemory::close");
             fd = -1;
+            size = 0;
 #endif
             ptr = nullptr;
         }
@@ -269,9 +338,14 @@ public:
         if (filename.isNotEmpty())
         {
 #ifndef DISTRHO_OS_WINDOWS
-            try {
-                ::shm_unlink(filename);
-            } DISTRHO_SAFE_EXCEPTION("SharedMemory::close");
+            if (! anonymous)
+            {
+                try {
+                    ::shm_unlink(filename);
+                } DISTRHO_SAFE_EXCEPTION("SharedMemory::close");
+            }
+
+            anonymous = false;
 #endif
             filename.clear();
         }
@@ -294,6 +368,56 @@ public:
     }
 
 private:
+#ifndef DISTRHO_OS_WINDOWS
+    static int getMapFlags(const uint flags) noexcept
+    {
+        return MAP_SHARED|MAP_LOCKED|((flags & kSharedMemoryPrefault) != 0 ? MAP_POPULATE : 0);
+    }
+#endif
+
+#ifdef DISTRHO_SHARED_MEMORY_MEMFD
+    bool createAnonymous(const uint mfdFlags, const uint flags)
+    {
+        // Anonymous files cannot collide, no need to look for a free name
+        const int fd2 = ::memfd_create("dpf", MFD_CLOEXEC|mfdFlags);
+
+        if (fd2 < 0)
+            return false;
+
+        // Block size is the page size of the backing filesystem, that is the
+        // default huge page size for MFD_HUGETLB. Sizes must be a multiple.
+        struct stat st;
+        std::size_t size2 = N * sizeof(S);
+        void* ptr2 = MAP_FAILED;
+
+        if (::fstat(fd2, &st) == 0 && st.st_blksize > 0)
+        {
+            const std::size_t pageSize = static_cast<std::size_t>(st.st_blksize);
+            size2 = (size2 + pageSize - 1) / pageSize * pageSize;
+
+            if (::ftruncate(fd2, size2) == 0)
+                ptr2 = ::mmap(nullptr, size2, PROT_READ|PROT_WRITE, getMapFlags(flags), fd2, 0);
+        }
+
+        if (ptr2 == nullptr || ptr2 == MAP_FAILED)
+        {
+            ::close(fd2);
+            return false;
+        }
+
+        char filename2[64];
+        std::snprintf(filename2, sizeof(filename2), "/proc/%d/fd/%d", static_cast<int>(::getpid()), fd2);
+
+        fd = fd2;
+        ptr = (S*)ptr2;
+        size = size2;
+        anonymous = true;
+        filename = filename2;
+
+        return true;
+    }
+#endif
+
     S* ptr;
     String filename;
 
@@ -301,12 +425,96 @@ private:
     HANDLE map;
 #else
     int fd;
+    std::size_t size;
+    bool anonymous;
 #endif
 
     DISTRHO_PREVENT_VIRTUAL_HEAP_ALLOCATION
     DISTRHO_DECLARE_NON_COPYABLE(SharedMemory)
 };
 
+// -----------------------------------------------------------------------
+// Publishes values of a trivially copyable type from a single writer, like
+// the plugin run() method, to readers in another process. The writer never
+// blocks and alternates between two copies, each guarded by a seqlock, so a
+// reader has a whole write period to copy the latest value before it gets
+// overwritten. Readers retry when they collide with the writer anyway.
+// Meant to live in shared memory, construct it with placement new.
+
+template<class T>
+class SharedMemorySnapshot
+{
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+    SharedMemorySnapshot() noexcept
+        : fLatest(0),
+          fWriting(0)
+    {
+        fSlots[0].sequence = 0;
+        fSlots[1].sequence = 0;
+    }
+
+    // Writer side. Fill the returned value in place then call endWrite(),
+    // which makes it visible to readers.
+    T& beginWrite() noexcept
+    {
+        fWriting = fLatest.load(std::memory_order_relaxed) ^ 1;
+        Slot& slot = fSlots[fWriting];
+        slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return slot.value;
+    }
+
+    void endWrite() noexcept
+    {
+        Slot& slot = fSlots[fWriting];
+        slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        fLatest.store(fWriting, std::memory_order_release);
+    }
+
+    void write(const T& value) noexcept
+    {
+        beginWrite() = value;
+        endWrite();
+    }
+
+    // Reader side. Returns false when no consistent copy could be made within
+    // maxRetries attempts, value contents are undefined in such case.
+    bool read(T& value, int maxRetries = 8) const noexcept
+    {
+        for (int i = 0; i <= maxRetries; ++i)
+        {
+            const Slot& slot = fSlots[fLatest.load(std::memory_order_acquire)];
+            const uint32_t seq1 = slot.sequence.load(std::memory_order_acquire);
+
+            if ((seq1 & 1) != 0)
+                continue; // being written
+
+            std::memcpy(&value, &slot.value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (slot.sequence.load(std::memory_order_relaxed) == seq1)
+                return true;
+        }
+
+        return false;
+    }
+
+private:
+    struct Slot
+    {
+        alignas(64) std::atomic<uint32_t> sequence; // odd while written
+        T value;
+    };
+
+    Slot fSlots[2];
+    alignas(64) std::atomic<uint32_t> fLatest;
+    uint32_t fWriting; // writer only
+
+    DISTRHO_DECLARE_NON_COPYABLE(SharedMemorySnapshot)
+};
+
 // -----------------------------------------------------------------------
 
 END_NAMESPACE_DISTRHO
@@ -0,0 +1,444 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2021-2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SHARED_MEMORY_HEADER_HPP
+#define SHARED_MEMORY_HEADER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifndef DISTRHO_OS_WINDOWS
+# include <sched.h>
+#endif
+
+#include "distrho/DistrhoUtils.hpp"
+
+#include "extra/SharedMemory.hpp"
+
+START_NAMESPACE_DISTRHO
+
+// Lives at the start of the shared memory segment created by UIEx, the user
+// data returned by getSharedMemoryPointer() follows it. Both sides run in
+// different processes for some hosts, so only lock-free atomics are allowed.
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "Shared memory requires lock-free atomics");
+
+// Announces a UI write into the user data, the sequence number increments by
+// one on every command so readers can tell the order of writes
+
+struct SharedMemoryCommand
+{
+    uint32_t sequence;
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Single producer (UI) single consumer (plugin run()) queue
+
+template<uint32_t N>
+class SharedMemoryCommandRing
+{
+public:
+    static_assert((N & (N - 1)) == 0, "Ring size must be a power of two");
+
+    SharedMemoryCommandRing() noexcept
+        : fWriteIndex(0)
+        , fReadIndex(0)
+    {}
+
+    bool push(uint32_t offset, uint32_t size) noexcept
+    {
+        const uint32_t w = fWriteIndex.load(std::memory_order_relaxed);
+
+        if ((w - fReadIndex.load(std::memory_order_acquire)) == N) {
+            return false; // full
+        }
+
+        SharedMemoryCommand& cmd = fCommands[w & (N - 1)];
+        cmd.sequence = w;
+        cmd.offset = offset;
+        cmd.size = size;
+
+        fWriteIndex.store(w + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool pop(SharedMemoryCommand& cmd) noexcept
+    {
+        const uint32_t r = fReadIndex.load(std::memory_order_relaxed);
+
+        if (r == fWriteIndex.load(std::memory_order_acquire)) {
+            return false; // empty
+        }
+
+        cmd = fCommands[r & (N - 1)];
+
+        fReadIndex.store(r + 1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    // Indexes wrap around at 2^32, separate cache lines avoid false sharing
+    alignas(64) std::atomic<uint32_t> fWriteIndex;
+    alignas(64) std::atomic<uint32_t> fReadIndex;
+    alignas(64) SharedMemoryCommand   fCommands[N];
+};
+
+// Named regions carved out of the user data, offsets are relative to its start
+
+struct SharedMemoryRegion
+{
+    char     name[32];
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Changes are serialized by a spinlock and can come from either process, they
+// are not meant for the audio thread. Lookups do not take the lock, they retry
+// while a change is in progress. Waiting is bounded by time in both cases so
+// a peer that died while changing the directory cannot hang the caller,
+// operations fail instead. The version number changes on every create, resize and remove.
+// Regions never move because the other process may be using them, resizing
+// fails when there is no room after the region. Stop all users, then remove
+// and create the region again to grow it in such case.
+
+class SharedMemoryDirectory
+{
+public:
+    static constexpr int      kMaxRegions = 16;
+    static constexpr uint32_t kAlignment = 64;
+    static constexpr int      kTimeoutMs = 100;
+
+    explicit SharedMemoryDirectory(uint32_t capacity) noexcept
+        : fVersion(0)
+        , fCapacity(capacity)
+        , fCount(0)
+    {
+        fLock.clear();
+    }
+
+    uint32_t getVersion() const noexcept
+    {
+        return fVersion.load(std::memory_order_acquire);
+    }
+
+    // Returns false if the region does not exist or a change was in progress
+    // until the timeout
+    bool find(const char* name, SharedMemoryRegion& region) const noexcept
+    {
+        Backoff backoff;
+
+        do {
+            const uint32_t version = fVersion.load(std::memory_order_acquire);
+
+            if ((version & 1) != 0) {
+                continue; // change in progress
+            }
+
+            const int idx = indexOf(name);
+
+            if (idx != -1) {
+                region = fRegions[idx];
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (fVersion.load(std::memory_order_relaxed) == version) {
+                return idx != -1;
+            }
+        } while (backoff.wait());
+
+        d_stderr2("SharedMemoryDirectory : lookup timed out");
+
+        return false;
+    }
+
+    bool create(const char* name, uint32_t size, SharedMemoryRegion& region) noexcept
+    {
+        if ((std::strlen(name) >= sizeof(region.name)) || (size == 0)) {
+            return false;
+        }
+
+        if (! beginChange()) {
+            return false;
+        }
+
+        uint32_t offset;
+        const bool ok = (fCount < kMaxRegions) && (indexOf(name) == -1)
+                            && findGap(size, offset);
+
+        if (ok) {
+            std::strcpy(region.name, name);
+            region.offset = offset;
+            region.size = size;
+            insert(region);
+        }
+
+        endChange();
+
+        return ok;
+    }
+
+    // Fails if the region cannot grow in place, see above
+    bool resize(const char* name, uint32_t size, SharedMemoryRegion& region) noexcept
+    {
+        if (size == 0) {
+            return false;
+        }
+
+        if (! beginChange()) {
+            return false;
+        }
+
+        const int idx = indexOf(name);
+        bool ok = idx != -1;
+
+        if (ok) {
+            SharedMemoryRegion& r = fRegions[idx];
+            const uint32_t limit = idx + 1 < fCount ? fRegions[idx + 1].offset : fCapacity;
+            ok = size <= limit - r.offset;
+
+            if (ok) {
+                r.size = size;
+                region = r;
+            }
+        }
+
+        endChange();
+
+        return ok;
+    }
+
+    bool remove(const char* name) noexcept
+    {
+        if (! beginChange()) {
+            return false;
+        }
+
+        const int idx = indexOf(name);
+
+        if (idx != -1) {
+            erase(idx);
+        }
+
+        endChange();
+
+        return idx != -1;
+    }
+
+private:
+    // Waits are bounded by time, a peer in a change may have been preempted.
+    // Yielding between attempts lets it run when both share a core.
+    class Backoff
+    {
+    public:
+        Backoff() noexcept
+            : fStart(std::chrono::steady_clock::now())
+        {}
+
+        // Returns false once kTimeoutMs elapsed
+        bool wait() const noexcept
+        {
+            if (std::chrono::steady_clock::now() - fStart > std::chrono::milliseconds(kTimeoutMs)) {
+                return false;
+            }
+#ifdef DISTRHO_OS_WINDOWS
+            Sleep(0);
+#else
+            sched_yield();
+#endif
+            return true;
+        }
+
+    private:
+        std::chrono::steady_clock::time_point fStart;
+    };
+
+    bool beginChange() noexcept
+    {
+        Backoff backoff;
+
+        while (fLock.test_and_set(std::memory_order_acquire)) {
+            if (! backoff.wait()) {
+                d_stderr2("SharedMemoryDirectory : lock timed out");
+                return false;
+            }
+        }
+
+        fVersion.store(fVersion.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        return true;
+    }
+
+    void endChange() noexcept
+    {
+        fVersion.store(fVersion.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        fLock.clear(std::memory_order_release);
+    }
+
+    int indexOf(const char* name) const noexcept
+    {
+        for (int i = 0; i < fCount; ++i) {
+            if (std::strncmp(fRegions[i].name, name, sizeof(fRegions[i].name)) == 0) {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    // First fit, regions are sorted by offset
+    bool findGap(uint32_t size, uint32_t& offset) const noexcept
+    {
+        uint32_t start = 0;
+
+        for (int i = 0; i <= fCount; ++i) {
+            const uint32_t end = i < fCount ? fRegions[i].offset : fCapacity;
+
+            if ((start <= end) && (size <= end - start)) {
+                offset = start;
+                return true;
+            }
+
+            if (i < fCount) {
+                start = align(fRegions[i].offset + fRegions[i].size);
+            }
+        }
+
+        return false;
+    }
+
+    void insert(const SharedMemoryRegion& region) noexcept
+    {
+        int i = fCount++;
+
+        for (; (i > 0) && (fRegions[i - 1].offset > region.offset); --i) {
+            fRegions[i] = fRegions[i - 1];
+        }
+
+        fRegions[i] = region;
+    }
+
+    void erase(int idx) noexcept
+    {
+        for (int i = idx; i < fCount - 1; ++i) {
+            fRegions[i] = fRegions[i + 1];
+        }
+
+        fCount--;
+    }
+
+    static uint32_t align(uint32_t offset) noexcept
+    {
+        return (offset + kAlignment - 1) & ~(kAlignment - 1);
+    }
+
+    std::atomic<uint32_t> fVersion; // odd while a change is in progress
+    std::atomic_flag      fLock;
+    uint32_t              fCapacity;
+    int                   fCount;
+    SharedMemoryRegion    fRegions[kMaxRegions];
+};
+
+struct alignas(64) SharedMemoryHeader
+{
+    static constexpr uint32_t kMagic = 0x44504657; // 'DPFW'
+
+    explicit SharedMemoryHeader(uint32_t dataSize) noexcept
+        : magic(kMagic)
+        , consumerActive(false)
+        , regions(dataSize)
+    {}
+
+    bool isValid() const noexcept
+    {
+        return magic == kMagic;
+    }
+
+    uint8_t* getData() noexcept
+    {
+        return reinterpret_cast<uint8_t*>(this) + sizeof(SharedMemoryHeader);
+    }
+
+    uint8_t* createRegion(const char* name, size_t size) noexcept
+    {
+        SharedMemoryRegion region;
+
+        if ((size > UINT32_MAX) || ! regions.create(name, static_cast<uint32_t>(size), region)) {
+            return nullptr;
+        }
+
+        return getData() + region.offset;
+    }
+
+    uint8_t* findRegion(const char* name, size_t* size) noexcept
+    {
+        SharedMemoryRegion region;
+
+        if (! regions.find(name, region)) {
+            return nullptr;
+        }
+
+        if (size != nullptr) {
+            *size = region.size;
+        }
+
+        return getData() + region.offset;
+    }
+
+    uint8_t* resizeRegion(const char* name, size_t size) noexcept
+    {
+        SharedMemoryRegion region;
+
+        if ((size > UINT32_MAX) || ! regions.resize(name, static_cast<uint32_t>(size), region)) {
+            return nullptr;
+        }
+
+        return getData() + region.offset;
+    }
+
+    uint32_t magic;
+    std::atomic<bool> consumerActive; // set once the plugin drains commands
+    SharedMemoryCommandRing<64> commands;
+    SharedMemoryDirectory regions;
+};
+
+// Offset of the user data from the segment start
+constexpr size_t kSharedMemoryDataOffset = sizeof(SharedMemoryHeader);
+
+// Named segments are the default, anonymous ones are opened by web views
+// through the creator procfs, which sandboxed renderers (CEF sandbox, WebKit
+// bubblewrap) and processes in other PID or mount namespaces cannot reach.
+// Prefaulting spares the audio thread from page faults on first access, which
+// MAP_LOCKED alone does not guarantee when it exceeds RLIMIT_MEMLOCK
+#if defined(DPF_WEBUI_SHARED_MEMORY_HUGE_PAGES)
+constexpr uint kSharedMemoryCreateFlags = kSharedMemoryAnonymous|kSharedMemoryHugePages|kSharedMemoryPrefault;
+#elif defined(DPF_WEBUI_SHARED_MEMORY_ANONYMOUS)
+constexpr uint kSharedMemoryCreateFlags = kSharedMemoryAnonymous|kSharedMemoryPrefault;
+#else
+constexpr uint kSharedMemoryCreateFlags = kSharedMemoryPrefault;
+#endif
+constexpr uint kSharedMemoryConnectFlags = kSharedMemoryPrefault;
+
+END_NAMESPACE_DISTRHO
+
+#endif  // SHARED_MEMORY_HEADER_HPP
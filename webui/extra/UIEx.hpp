@@ -23,7 +23,9 @@
 # if ! DISTRHO_PLUGIN_WANT_STATE
 #  error Shared memory support requires DISTRHO_PLUGIN_WANT_STATE
 # endif
+# include <atomic>
 # include "extra/SharedMemory.hpp"
+# include "extra/SharedMemoryHeader.hpp"
 #endif 
 
 START_NAMESPACE_DISTRHO
@@ -42,9 +44,21 @@ public:
     // https://github.com/DISTRHO/OneKnob-Series/issues/6
 
 #if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
-    uint8_t* getSharedMemoryPointer() const noexcept;
-    bool     writeSharedMemory(const uint8_t* data, size_t size, size_t offset = 0) noexcept;
-    void     notifySharedMemoryWillDisconnect();
+    // Safe to call from any thread, null until sharedMemoryCreated() returned
+    uint8_t*    getSharedMemoryPointer() const noexcept;
+    const char* getSharedMemoryName() const noexcept;
+    bool        writeSharedMemory(const uint8_t* data, size_t size, size_t offset = 0) noexcept;
+    void        notifySharedMemoryWritten(size_t size, size_t offset = 0);
+    void        notifySharedMemoryWillDisconnect();
+
+    // Named regions within the shared memory, not real-time safe. Regions do
+    // not move, resizing fails when one cannot grow in place. The version
+    // changes on every create, resize and remove.
+    uint8_t*    createSharedMemoryRegion(const char* name, size_t size) noexcept;
+    uint8_t*    getSharedMemoryRegion(const char* name, size_t* size = nullptr) const noexcept;
+    uint8_t*    resizeSharedMemoryRegion(const char* name, size_t size) noexcept;
+    bool        removeSharedMemoryRegion(const char* name) noexcept;
+    uint32_t    getSharedMemoryRegionsVersion() const noexcept;
 #endif
 
 protected:
@@ -59,7 +73,10 @@ protected:
 
 private:
 #if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
-    SharedMemory<uint8_t,DPF_WEBUI_SHARED_MEMORY_SIZE> fMemory;
+    SharedMemoryHeader* getSharedMemoryHeader() const noexcept;
+
+    SharedMemory<uint8_t,kSharedMemoryDataOffset + DPF_WEBUI_SHARED_MEMORY_SIZE> fMemory;
+    std::atomic<uint8_t*> fMemoryData; // published once the segment is set up
 #endif
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(UIEx)
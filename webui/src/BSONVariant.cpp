@@ -14,8 +14,7 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include <stdexcept>
-#include <string>
+#include <cstring>
 
 #include "extra/BSONVariant.hpp"
 
@@ -23,21 +22,25 @@ USE_NAMESPACE_DISTRHO
 
 BSONVariant::BSONVariant() noexcept
     : fType(BSON_TYPE_NULL)
+    , fCount(0)
     , fDocument(nullptr)
 {}
 
 BSONVariant::BSONVariant(bool b) noexcept
     : fType(BSON_TYPE_BOOL)
+    , fCount(0)
     , fBool(b)
 {}
 
 BSONVariant::BSONVariant(double d) noexcept
     : fType(BSON_TYPE_DOUBLE)
+    , fCount(0)
     , fDouble(d)
 {}
 
 BSONVariant::BSONVariant(String s) noexcept
     : fType(BSON_TYPE_UTF8)
+    , fCount(0)
 {
     fString = new char[s.length() + 1];
     std::strcpy(fString, s.buffer());
@@ -45,27 +48,32 @@ BSONVariant::BSONVariant(String s) noexcept
 
 BSONVariant::BSONVariant(const BinaryData& data) noexcept
     : fType(BSON_TYPE_BINARY)
+    , fCount(0)
 {
     fData = new BinaryData(data.begin(), data.end());
 }
 
 BSONVariant::BSONVariant(int32_t i) noexcept
     : fType(BSON_TYPE_INT32)
+    , fCount(0)
     , fInt(i)
 {}
 
 BSONVariant::BSONVariant(uint32_t i) noexcept
     : fType(BSON_TYPE_INT32)
+    , fCount(0)
     , fInt(static_cast<int32_t>(i))
 {}
 
 BSONVariant::BSONVariant(float f) noexcept
     : fType(BSON_TYPE_DOUBLE)
+    , fCount(0)
     , fDouble(static_cast<double>(f))
 {}
 
 BSONVariant::BSONVariant(const char* s) noexcept
     : fType(BSON_TYPE_UTF8)
+    , fCount(0)
 {
     fString = new char[std::strlen(s) + 1];
     std::strcpy(fString, s);
@@ -73,6 +81,7 @@ BSONVariant::BSONVariant(const char* s) noexcept
 
 BSONVariant::BSONVariant(std::initializer_list<KeyValue> items) noexcept
     : fType(BSON_TYPE_DOCUMENT)
+    , fCount(0)
     , fDocument(bson_new())
 {
     for (std::initializer_list<KeyValue>::const_iterator it = items.begin();
@@ -83,6 +92,7 @@ BSONVariant::BSONVariant(std::initializer_list<KeyValue> items) noexcept
 
 BSONVariant::BSONVariant(std::initializer_list<BSONVariant> items) noexcept
     : fType(BSON_TYPE_ARRAY)
+    , fCount(0)
     , fDocument(bson_new())
 {
     for (std::initializer_list<BSONVariant>::const_iterator it = items.begin();
@@ -197,7 +207,7 @@ String BSONVariant::asString() const noexcept
 
 bool BSONVariant::getBoolean() const noexcept
 {
-    return fString;
+    return (fType == BSON_TYPE_BOOL) && fBool;
 }
 
 double BSONVariant::getNumber() const noexcept
@@ -225,12 +235,13 @@ BinaryData BSONVariant::getBinaryData() const noexcept
 
 int BSONVariant::getArraySize() const noexcept
 {
-    return bson_count_keys(fDocument);
+    return fCount;
 }
 
 BSONVariant BSONVariant::getArrayItem(int idx) const noexcept
 {
-    return get(fDocument, String(idx).buffer());
+    ArrayKey key;
+    return get(fDocument, key.get(idx));
 }
 
 BSONVariant BSONVariant::getObjectItem(const char* key) const noexcept
@@ -250,29 +261,34 @@ BSONVariant BSONVariant::operator[](const char* key) const noexcept
 
 void BSONVariant::pushArrayItem(const BSONVariant& var) noexcept
 {
-    String key(bson_count_keys(fDocument));
-    set(fDocument, key.buffer(), var);
-}
+    if (fDocument == nullptr) {
+        return;
+    }
 
-void BSONVariant::setArrayItem(int idx, const BSONVariant& var) noexcept
-{
-    String key(idx);
-    set(fDocument, key.buffer(), var);
+    ArrayKey key;
+    set(fDocument, key.get(fCount++), var);
 }
 
-void BSONVariant::insertArrayItem(int idx, const BSONVariant& var) noexcept
+void BSONVariant::setArrayItem(int idx, const BSONVariant& var) noexcept
 {
     if (fDocument == nullptr) {
         return;
     }
 
-    bson_iter_t iter;
+    ArrayKey key;
+    set(fDocument, key.get(idx), var);
+    fCount++; // appended even if the key exists, same as bson_count_keys()
+}
 
-    if (! bson_iter_init(&iter, fDocument)) {
+// Array keys must stay sequential so the document is rebuilt, items are
+// renumbered by position in a single pass.
+void BSONVariant::insertArrayItem(int idx, const BSONVariant& var) noexcept
+{
+    if ((fDocument == nullptr) || (idx < 0)) {
         return;
     }
 
-    int keyCount = static_cast<int>(bson_count_keys(fDocument));
+    const int keyCount = fCount;
 
     if (idx > keyCount) {
         return;
@@ -283,33 +299,96 @@ void BSONVariant::insertArrayItem(int idx, const BSONVariant& var) noexcept
         return;
     }
 
-    bson_t* newArr = bson_new();
-    int newIdx;
+    bson_iter_t iter;
 
-    while (bson_iter_next(&iter)) {
-        try {
-            newIdx = std::stoi(bson_iter_key(&iter));
-        } catch (std::invalid_argument const& ex) {
-            bson_destroy(newArr);
-            return;
-        }
+    if (! bson_iter_init(&iter, fDocument)) {
+        return;
+    }
 
-        if (newIdx >= idx) {
-            newIdx++;
+    bson_t* newArr = bson_sized_new(fDocument->len + 32);
+    ArrayKey key;
+    int newIdx = 0;
+
+    while (bson_iter_next(&iter)) {
+        if (newIdx == idx) {
+            set(newArr, key.get(newIdx++), var);
         }
 
-        bson_append_iter(newArr, String(newIdx).buffer(), -1, &iter);
+        bson_append_iter(newArr, key.get(newIdx++), -1, &iter);
     }
 
     bson_destroy(fDocument);
     fDocument = newArr;
+    fCount = newIdx;
+}
 
-    set(fDocument, String(idx).buffer(), var);
+BSONVariant BSONVariant::sliceArray(int start, int end) const noexcept
+{
+    if (! isArray()) {
+        return BSONVariant();
+    }
+
+    BSONVariant b = createArray();
+    const int size = getArraySize();
+
+    if ((start < 0) || (start == end) || (start >= size)) {
+        return b;
+    }
+
+    if ((end < 0)/*def value*/ || (end > size)) {
+        end = size;
+    }
+
+    bson_iter_t iter;
+
+    if (! bson_iter_init(&iter, fDocument)) {
+        return b;
+    }
+
+    ArrayKey key;
+
+    for (int i = 0; (i < end) && bson_iter_next(&iter); ++i) {
+        if (i >= start) {
+            bson_append_iter(b.fDocument, key.get(b.fCount++), -1, &iter);
+        }
+    }
+
+    return b;
+}
+
+BSONVariant& BSONVariant::operator+=(const BSONVariant& other) noexcept
+{
+    if (! isArray() || ! other.isArray()) {
+        return *this;
+    }
+
+    if (&other == this) {
+        const BSONVariant copy(other); // appending invalidates the iterator
+        return *this += copy;
+    }
+
+    bson_iter_t iter;
+
+    if (! bson_iter_init(&iter, other.fDocument)) {
+        return *this;
+    }
+
+    ArrayKey key;
+    while (bson_iter_next(&iter)) {
+        bson_append_iter(fDocument, key.get(fCount++), -1, &iter);
+    }
+
+    return *this;
 }
 
 void BSONVariant::setObjectItem(const char* key, const BSONVariant& var) noexcept
 {
+    if (fDocument == nullptr) {
+        return;
+    }
+
     set(fDocument, key, var);
+    fCount++;
 }
 
 BinaryData BSONVariant::toBSON() const noexcept
@@ -362,12 +441,14 @@ BSONVariant BSONVariant::fromJSON(const char* jsonText) noexcept
 
 BSONVariant::BSONVariant(bson_type_t type, bson_t* document) noexcept
     : fType(type)
+    , fCount(document != nullptr ? static_cast<int>(bson_count_keys(document)) : 0)
     , fDocument(document)
 {}
 
 void BSONVariant::copy(const BSONVariant& var) noexcept
 {
     fType = var.fType;
+    fCount = var.fCount;
 
     switch (var.fType) {
         case BSON_TYPE_BOOL:
@@ -398,8 +479,10 @@ void BSONVariant::copy(const BSONVariant& var) noexcept
 void BSONVariant::move(BSONVariant&& var) noexcept
 {
     fType = var.fType;
+    fCount = var.fCount;
     fDocument = var.fDocument;
     var.fType = BSON_TYPE_EOD;
+    var.fCount = 0;
     var.fDocument = nullptr;
 }
 
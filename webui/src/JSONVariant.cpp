@@ -247,6 +247,51 @@ void JSONVariant::insertArrayItem(int idx, const JSONVariant& value) noexcept
     cJSON_InsertItemInArray(fImpl, idx, cJSON_Duplicate(value.fImpl, true));
 }
 
+// Walk the children list once instead of looking up every index, each item
+// is only duplicated once
+JSONVariant JSONVariant::sliceArray(int start, int end) const noexcept
+{
+    if (! isArray()) {
+        return JSONVariant();
+    }
+
+    JSONVariant b = createArray();
+    const int size = getArraySize();
+
+    if ((start < 0) || (start == end) || (start >= size)) {
+        return b;
+    }
+
+    if ((end < 0)/*def value*/ || (end > size)) {
+        end = size;
+    }
+
+    const cJSON* item = cJSON_GetArrayItem(fImpl, start);
+
+    for (int i = start; (i < end) && (item != nullptr); ++i, item = item->next) {
+        cJSON_AddItemToArray(b.fImpl, cJSON_Duplicate(item, true));
+    }
+
+    return b;
+}
+
+JSONVariant& JSONVariant::operator+=(const JSONVariant& other) noexcept
+{
+    if (! isArray() || ! other.isArray()) {
+        return *this;
+    }
+
+    // Size is read first so appending an array to itself terminates
+    const int size = other.getArraySize();
+    const cJSON* item = other.fImpl->child;
+
+    for (int i = 0; (i < size) && (item != nullptr); ++i, item = item->next) {
+        cJSON_AddItemToArray(fImpl, cJSON_Duplicate(item, true));
+    }
+
+    return *this;
+}
+
 void JSONVariant::setObjectItem(const char* key, const JSONVariant& value) noexcept
 {
     if (cJSON_HasObjectItem(fImpl, key)) {
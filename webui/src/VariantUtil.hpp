@@ -25,56 +25,6 @@ START_NAMESPACE_DISTRHO
 
 typedef std::vector<uint8_t> BinaryData;
 
-template<class T>
-T sliceVariantArray(const T& a, int start, int end = -1) noexcept
-{
-    if (! a.isArray()) {
-        return T();
-    }
-
-    T b = T::createArray();
-
-    if (! a.isArray()) {
-        return b;
-    }
-
-    if ((start < 0) || (start == end)) {
-        return b;
-    }
-
-    const int size = a.getArraySize();
-
-    if (start >= size) {
-        return b;
-    }
-
-    if ((end < 0)/*def value*/ || (end > size)) {
-        end = size;
-    }
-
-    for (int i = start; i < end; ++i) {
-        b.pushArrayItem(a.getArrayItem(i));
-    }
-
-    return b;
-}
-
-template<class T>
-T& joinVariantArrays(T& a, const T& b) noexcept
-{
-    if (! a.isArray() || ! b.isArray()) {
-        return a;
-    }
-
-    const int size = b.getArraySize();
-
-    for (int i = 0; i < size; ++i) {
-        a.pushArrayItem(b.getArrayItem(i));
-    }
-
-    return a;
-}
-
 END_NAMESPACE_DISTRHO
 
 #endif // VARIANT_UTIL_HPP
@@ -68,6 +68,10 @@ PluginEx::PluginEx(uint32_t parameterCount, uint32_t programCount, uint32_t stat
 #if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
     , fStateIndexShMemFile(stateCount + __COUNTER__)
     , fStateIndexShMemData(stateCount + __COUNTER__)
+    , fMemory(nullptr)
+    , fMemoryHeader(nullptr)
+    , fMemoryEpoch(0)
+    , fMemoryData(nullptr)
 #endif
 #if DPF_WEBUI_ZEROCONF
     , fStateIndexZeroconfPublish(stateCount + __COUNTER__)
@@ -76,6 +80,18 @@ PluginEx::PluginEx(uint32_t parameterCount, uint32_t programCount, uint32_t stat
 #endif
 {}
 
+PluginEx::~PluginEx()
+{
+#if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
+    // run() is not called anymore
+    delete fMemory;
+
+    for (size_t i = 0; i < fRetiredMemory.size(); ++i) {
+        delete fRetiredMemory[i].first;
+    }
+#endif
+}
+
 #if DISTRHO_PLUGIN_WANT_STATE
 void PluginEx::initState(uint32_t index, State& state)
 {
@@ -116,17 +132,30 @@ void PluginEx::setState(const char* key, const char* value)
     (void)key;
     (void)value;
 # if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
+    // Wait-free, segments disconnected while run() was using them stay mapped
+    // until a later state call finds that run() is done with them
+    if (! fRetiredMemory.empty()) {
+        unmapRetiredSharedMemory();
+    }
+
     // Do not persist _shmem_* values by returning before setting fState
     if (std::strcmp("_shmem_file", key) == 0) {
         if (value[0] != '\0') {
-            if (std::strcmp(value, "close") == 0) {
-                sharedMemoryWillDisconnect();
-                fMemory.close();
-            } else {
-                uint8_t* ptr = fMemory.connect(value);
+            disconnectSharedMemory();
+
+            if (std::strcmp(value, "close") != 0) {
+                fMemory = new PluginSharedMemory;
+                uint8_t* ptr = fMemory->connect(value, kSharedMemoryConnectFlags);
                 if (ptr != nullptr) { 
-                    sharedMemoryConnected(ptr);
+                    SharedMemoryHeader* header = reinterpret_cast<SharedMemoryHeader*>(ptr);
+                    if (header->isValid()) {
+                        fMemoryHeader = header;
+                    }
+                    fMemoryData = ptr + kSharedMemoryDataOffset;
+                    sharedMemoryConnected(fMemoryData);
                 } else {
+                    delete fMemory;
+                    fMemory = nullptr;
                     d_stderr2("PluginEx : could not connect to shared memory");
                 }
             }
@@ -163,12 +192,12 @@ String PluginEx::getState(const char* key) const
 #if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
 uint8_t* PluginEx::getSharedMemoryPointer() const noexcept
 {
-    return fMemory.getDataPointer();
+    return fMemoryData;
 }
 
 bool PluginEx::writeSharedMemory(const uint8_t* data, size_t size, size_t offset) const noexcept
 {
-    uint8_t* ptr = fMemory.getDataPointer();
+    uint8_t* ptr = getSharedMemoryPointer();
 
     if (ptr == nullptr) {
         return false;
@@ -178,4 +207,104 @@ bool PluginEx::writeSharedMemory(const uint8_t* data, size_t size, size_t offset
 
     return true;
 }
+
+uint8_t* PluginEx::createSharedMemoryRegion(const char* name, size_t size) noexcept
+{
+    SharedMemoryHeader* header = fMemoryHeader;
+    return header != nullptr ? header->createRegion(name, size) : nullptr;
+}
+
+uint8_t* PluginEx::getSharedMemoryRegion(const char* name, size_t* size) const noexcept
+{
+    SharedMemoryHeader* header = fMemoryHeader;
+    return header != nullptr ? header->findRegion(name, size) : nullptr;
+}
+
+uint8_t* PluginEx::resizeSharedMemoryRegion(const char* name, size_t size) noexcept
+{
+    SharedMemoryHeader* header = fMemoryHeader;
+    return header != nullptr ? header->resizeRegion(name, size) : nullptr;
+}
+
+bool PluginEx::removeSharedMemoryRegion(const char* name) noexcept
+{
+    SharedMemoryHeader* header = fMemoryHeader;
+    return header != nullptr ? header->regions.remove(name) : false;
+}
+
+uint32_t PluginEx::getSharedMemoryRegionsVersion() const noexcept
+{
+    SharedMemoryHeader* header = fMemoryHeader;
+    return header != nullptr ? header->regions.getVersion() : 0;
+}
+
+void PluginEx::processSharedMemoryCommands() noexcept
+{
+    // Sequentially consistent epoch and pointer accesses guarantee that
+    // disconnectSharedMemory() either sees an odd epoch or this sees a null
+    // header, see unmapRetiredSharedMemory()
+    fMemoryEpoch.fetch_add(1);
+    SharedMemoryHeader* header = fMemoryHeader;
+
+    if (header == nullptr) {
+        fMemoryEpoch.fetch_add(1, std::memory_order_release);
+        return;
+    }
+
+    // Tells UIEx to start queueing, writes notified before went through state
+    if (! header->consumerActive.load(std::memory_order_relaxed)) {
+        header->consumerActive.store(true, std::memory_order_release);
+    }
+
+    uint8_t* ptr = reinterpret_cast<uint8_t*>(header) + kSharedMemoryDataOffset;
+    SharedMemoryCommand cmd;
+
+    while (header->commands.pop(cmd)) {
+        if ((cmd.offset <= DPF_WEBUI_SHARED_MEMORY_SIZE)
+                && (cmd.size <= DPF_WEBUI_SHARED_MEMORY_SIZE - cmd.offset)) {
+            sharedMemoryWritten(ptr, cmd.size, cmd.offset);
+        }
+    }
+
+    fMemoryEpoch.fetch_add(1, std::memory_order_release);
+}
+
+void PluginEx::disconnectSharedMemory()
+{
+    // Also reached when a new segment arrives without a previous "close", for
+    // example after the UI crashed
+    if (fMemory == nullptr) {
+        return;
+    }
+
+    sharedMemoryWillDisconnect();
+    fMemoryHeader = nullptr;
+    fMemoryData = nullptr;
+
+    // Retire the mapping, processSharedMemoryCommands() may still be using it
+    fRetiredMemory.push_back(RetiredSharedMemory(fMemory, fMemoryEpoch.load()));
+    fMemory = nullptr;
+
+    unmapRetiredSharedMemory();
+}
+
+void PluginEx::unmapRetiredSharedMemory()
+{
+    // An even epoch at retirement means no processSharedMemoryCommands() call
+    // could have loaded the header. Otherwise the call that did has returned
+    // once the epoch changes, calls never overlap.
+    const uint32_t epoch = fMemoryEpoch.load();
+    size_t i = 0;
+
+    while (i < fRetiredMemory.size()) {
+        const uint32_t retiredEpoch = fRetiredMemory[i].second;
+
+        if (((retiredEpoch & 1) == 0) || (retiredEpoch != epoch)) {
+            delete fRetiredMemory[i].first;
+            fRetiredMemory.erase(fRetiredMemory.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
 #endif
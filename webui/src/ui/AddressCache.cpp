@@ -0,0 +1,326 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "src/DistrhoDefines.h"
+
+#if defined(DISTRHO_OS_WINDOWS)
+# include <Winsock2.h>
+#else
+# include <arpa/inet.h>
+# include <ifaddrs.h>
+# include <net/if.h>
+# include <netinet/in.h>
+# include <poll.h>
+# include <sys/socket.h>
+# include <unistd.h>
+# if defined(DISTRHO_OS_LINUX)
+#  include <linux/netlink.h>
+#  include <linux/rtnetlink.h>
+# elif defined(DISTRHO_OS_MAC)
+#  include <net/route.h>
+# endif
+#endif
+
+#include "AddressCache.hpp"
+
+#define LOG_TAG "AddressCache"
+#define LOOPBACK_ADDRESS "127.0.0.1"
+#define POLL_INTERVAL_MS 250
+#if defined(DISTRHO_OS_WINDOWS)
+# define REFRESH_INTERVAL_MS 5000
+#endif
+
+USE_NAMESPACE_DISTRHO
+
+AddressCache::AddressCache()
+    : fAddress(LOOPBACK_ADDRESS)
+    , fSocket(-1)
+{
+    refresh();
+
+    // Interface and route changes are reported through a routing socket on
+    // Linux and macOS, Windows periodically repeats the lookup instead.
+#if defined(DISTRHO_OS_LINUX)
+    fSocket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    if (fSocket != -1) {
+        sockaddr_nl addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE; // default route too
+
+        if (bind(fSocket, (const sockaddr*)&addr, sizeof(addr)) == -1) {
+            d_stderr(LOG_TAG " : failed bind(), errno %d", errno);
+            ::close(fSocket);
+            fSocket = -1;
+        }
+    } else {
+        d_stderr(LOG_TAG " : failed socket(), errno %d", errno);
+    }
+#elif defined(DISTRHO_OS_MAC)
+    fSocket = socket(PF_ROUTE, SOCK_RAW, AF_UNSPEC);
+
+    if (fSocket == -1) {
+        d_stderr(LOG_TAG " : failed socket(), errno %d", errno);
+    }
+#endif
+
+#if ! defined(DISTRHO_OS_WINDOWS)
+    if (fSocket == -1) {
+        return; // address stays cached but is no longer refreshed
+    }
+#endif
+
+    startThread();
+}
+
+AddressCache::~AddressCache()
+{
+    stopThread(-1 /*wait forever*/);
+
+#if ! defined(DISTRHO_OS_WINDOWS)
+    if (fSocket != -1) {
+        ::close(fSocket);
+        fSocket = -1;
+    }
+#endif
+}
+
+String AddressCache::getAddress()
+{
+    const MutexLocker addressScopedLock(fMutex);
+    return fAddress;
+}
+
+void AddressCache::run()
+{
+#if defined(DISTRHO_OS_WINDOWS)
+    int elapsed = 0;
+
+    while (! shouldThreadExit()) {
+        Sleep(POLL_INTERVAL_MS);
+        elapsed += POLL_INTERVAL_MS;
+
+        if (elapsed >= REFRESH_INTERVAL_MS) {
+            elapsed = 0;
+            refresh();
+        }
+    }
+#else
+    pollfd pfd;
+    pfd.fd = fSocket;
+    pfd.events = POLLIN;
+
+    uint8_t buf[4096];
+
+    while (! shouldThreadExit()) {
+        pfd.revents = 0;
+
+        if (poll(&pfd, 1, POLL_INTERVAL_MS) <= 0) {
+            continue;
+        }
+
+        // Message content is irrelevant, drain the socket and look up again
+        while (recv(fSocket, buf, sizeof(buf), MSG_DONTWAIT) > 0) {}
+
+        refresh();
+    }
+#endif
+}
+
+void AddressCache::refresh()
+{
+    const String address = lookup();
+    const MutexLocker addressScopedLock(fMutex);
+    fAddress = address;
+}
+
+#if defined(DISTRHO_OS_WINDOWS)
+String AddressCache::lookup()
+{
+    // Find the interface of the default route. No packets are sent by
+    // connecting a UDP socket, it fails immediately when offline.
+    String address = LOOPBACK_ADDRESS;
+
+    const SOCKET sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd == INVALID_SOCKET) {
+        return address;
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("8.8.8.8"); // Google DNS
+    addr.sin_port = htons(53);
+
+    if (connect(sockfd, (const sockaddr*)&addr, sizeof(addr)) == 0) {
+        int addrlen = sizeof(addr);
+
+        if (getsockname(sockfd, (sockaddr*)&addr, &addrlen) == 0) {
+            address = inet_ntoa(addr.sin_addr);
+        }
+    }
+
+    closesocket(sockfd);
+
+    return address;
+}
+#else
+static bool isPrivateAddress(uint32_t addr)
+{
+    return ((addr & 0xff000000) == 0x0a000000)  // 10.0.0.0/8
+        || ((addr & 0xfff00000) == 0xac100000)  // 172.16.0.0/12
+        || ((addr & 0xffff0000) == 0xc0a80000); // 192.168.0.0/16
+}
+
+static bool isLinkLocalAddress(uint32_t addr)
+{
+    return (addr & 0xffff0000) == 0xa9fe0000;   // 169.254.0.0/16
+}
+
+#if defined(DISTRHO_OS_LINUX)
+// Interface of the IPv4 default route with the lowest metric, empty if none
+static String getDefaultRouteInterface()
+{
+    String iface;
+
+    FILE* const f = std::fopen("/proc/net/route", "r");
+    if (f == nullptr) {
+        return iface;
+    }
+
+    char line[256];
+    int bestMetric = -1;
+
+    // Iface Destination Gateway Flags RefCnt Use Metric Mask ..., hex fields
+    if (std::fgets(line, sizeof(line), f) != nullptr) { // header
+        while (std::fgets(line, sizeof(line), f) != nullptr) {
+            char name[IF_NAMESIZE];
+            unsigned long destination, gateway, mask;
+            unsigned int flags;
+            int refCnt, use, metric;
+
+            if ((std::sscanf(line, "%15s %lx %lx %x %d %d %d %lx", name, &destination, &gateway,
+                                &flags, &refCnt, &use, &metric, &mask) == 8)
+                    && (destination == 0) && (mask == 0) && (flags & 0x1 /*RTF_UP*/)
+                    && ((bestMetric == -1) || (metric < bestMetric))) {
+                iface = name;
+                bestMetric = metric;
+            }
+        }
+    }
+
+    std::fclose(f);
+
+    return iface;
+}
+#elif defined(DISTRHO_OS_MAC)
+// Source address of the IPv4 default route, 0 if none. No packets are sent by
+// connecting a UDP socket, it fails immediately when offline.
+static uint32_t getDefaultRouteAddress()
+{
+    uint32_t address = 0;
+
+    const int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd == -1) {
+        return address;
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("8.8.8.8"); // Google DNS
+    addr.sin_port = htons(53);
+
+    if (connect(sockfd, (const sockaddr*)&addr, sizeof(addr)) == 0) {
+        socklen_t addrlen = sizeof(addr);
+
+        if (getsockname(sockfd, (sockaddr*)&addr, &addrlen) == 0) {
+            address = ntohl(addr.sin_addr.s_addr);
+        }
+    }
+
+    ::close(sockfd);
+
+    return address;
+}
+#endif
+
+String AddressCache::lookup()
+{
+    // Prefer the interface carrying the default route, it is the one other
+    // devices reach when there are several like VPN or container bridges.
+    // Then prefer private addresses since they are the ones reachable from
+    // the local network, then any other usable address.
+    String address = LOOPBACK_ADDRESS;
+
+    ifaddrs* ifaddr;
+    if (getifaddrs(&ifaddr) == -1) {
+        d_stderr(LOG_TAG " : failed getifaddrs(), errno %d", errno);
+        return address;
+    }
+
+#if defined(DISTRHO_OS_LINUX)
+    const String defaultIface = getDefaultRouteInterface();
+#elif defined(DISTRHO_OS_MAC)
+    const uint32_t defaultAddr = getDefaultRouteAddress();
+#endif
+    int bestScore = 0;
+
+    for (ifaddrs* ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
+        if ((ifa->ifa_addr == nullptr) || (ifa->ifa_addr->sa_family != AF_INET)) {
+            continue;
+        }
+
+        if ((ifa->ifa_flags & IFF_LOOPBACK) || ! (ifa->ifa_flags & IFF_UP)
+                || ! (ifa->ifa_flags & IFF_RUNNING)) {
+            continue;
+        }
+
+        const in_addr sin_addr = reinterpret_cast<const sockaddr_in*>(ifa->ifa_addr)->sin_addr;
+        const uint32_t addr = ntohl(sin_addr.s_addr);
+
+        if (isLinkLocalAddress(addr)) {
+            continue;
+        }
+
+#if defined(DISTRHO_OS_LINUX)
+        const bool isDefault = defaultIface == ifa->ifa_name;
+#elif defined(DISTRHO_OS_MAC)
+        const bool isDefault = addr == defaultAddr;
+#else
+        const bool isDefault = false;
+#endif
+        const int score = (isDefault ? 2 : 0) + (isPrivateAddress(addr) ? 2 : 1);
+
+        if (score > bestScore) {
+            char buf[INET_ADDRSTRLEN];
+            if (inet_ntop(AF_INET, &sin_addr, buf, sizeof(buf)) != nullptr) {
+                address = buf;
+                bestScore = score;
+            }
+        }
+    }
+
+    freeifaddrs(ifaddr);
+
+    return address;
+}
+#endif // DISTRHO_OS_WINDOWS
@@ -0,0 +1,57 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef ADDRESS_CACHE_HPP
+#define ADDRESS_CACHE_HPP
+
+#include "distrho/extra/LeakDetector.hpp"
+#include "distrho/extra/Mutex.hpp"
+#include "distrho/extra/String.hpp"
+#include "distrho/extra/Thread.hpp"
+
+START_NAMESPACE_DISTRHO
+
+// Keeps the IPv4 address other devices in the local network can use for
+// reaching this machine. The address is looked up once and refreshed when the
+// system reports interface changes, so reading it never touches the network.
+// Falls back to the loopback address when no suitable interface is found.
+
+class AddressCache : public Thread
+{
+public:
+    AddressCache();
+    virtual ~AddressCache();
+
+    String getAddress();
+
+protected:
+    void run() override;
+
+private:
+    void   refresh();
+    String lookup();
+
+    Mutex  fMutex;
+    String fAddress;
+    int    fSocket;
+
+    DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AddressCache)
+
+};
+
+END_NAMESPACE_DISTRHO
+
+#endif  // ADDRESS_CACHE_HPP
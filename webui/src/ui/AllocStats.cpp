@@ -0,0 +1,137 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdlib>
+#include <new>
+
+#include "thirdparty/cJSON.h"
+
+#include "AllocStats.hpp"
+
+// Replacing the global allocation functions is meant to count plugin code
+// only. The replacements are exported like the standard ones because their
+// visibility cannot be changed, what they affect depends on symbol binding:
+// - ELF plugins are linked with -Bsymbolic-functions, see Makefile.plugins.mk.
+//   Without it a host that loaded libstdc++ first would serve plugin calls.
+//   Hosts load plugins with RTLD_LOCAL, their own calls are not affected.
+// - Windows DLLs and Mach-O two-level namespaces bind plugin calls to these
+//   definitions at link time, host calls resolve against their own images.
+// - Standalone (JACK) builds are executables, the replacements are process
+//   wide there. Counters are per thread and only read around UI handlers, so
+//   other threads do not show up, but libraries on the UI thread do.
+
+static thread_local uint64_t tAllocCount = 0;
+static thread_local uint64_t tAllocBytes = 0;
+
+static void* countedMalloc(std::size_t size) noexcept
+{
+    tAllocCount++;
+    tAllocBytes += size;
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* operator new(std::size_t size)
+{
+    void* ptr = countedMalloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+    void* ptr = countedMalloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return countedMalloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return countedMalloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+// cJSON allocates through its own hooks, install them before any Variant is created
+static void* cJSONMalloc(size_t size)
+{
+    return countedMalloc(size);
+}
+
+static void cJSONFree(void* ptr)
+{
+    std::free(ptr);
+}
+
+static struct cJSONHooksInstaller
+{
+    cJSONHooksInstaller()
+    {
+        cJSON_Hooks hooks = { cJSONMalloc, cJSONFree };
+        cJSON_InitHooks(&hooks);
+    }
+} gCJSONHooksInstaller;
+
+START_NAMESPACE_DISTRHO
+
+AllocCounter getThreadAllocCounter() noexcept
+{
+    return { tAllocCount, tAllocBytes };
+}
+
+void setThreadAllocCounter(const AllocCounter& counter) noexcept
+{
+    tAllocCount = counter.count;
+    tAllocBytes = counter.bytes;
+}
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,78 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "src/DistrhoDefines.h"
+
+START_NAMESPACE_DISTRHO
+
+// Heap allocations made by the calling thread since it started. Counts global
+// operator new and cJSON allocations, other malloc() callers are not seen.
+// Only available when building with DPF_WEBUI_ALLOC_STATS.
+
+struct AllocCounter
+{
+    uint64_t count;
+    uint64_t bytes;
+};
+
+AllocCounter getThreadAllocCounter() noexcept;
+void setThreadAllocCounter(const AllocCounter& counter) noexcept;
+
+// Measures allocations made by the current thread during its lifetime
+class AllocScope
+{
+public:
+    AllocScope() noexcept
+        : fStart(getThreadAllocCounter())
+    {}
+
+    AllocCounter get() const noexcept
+    {
+        const AllocCounter now = getThreadAllocCounter();
+        return { now.count - fStart.count, now.bytes - fStart.bytes };
+    }
+
+private:
+    const AllocCounter fStart;
+};
+
+// Allocations made by the current thread during its lifetime are not counted,
+// for bookkeeping that would otherwise show up in enclosing AllocScopes
+class AllocPause
+{
+public:
+    AllocPause() noexcept
+        : fSaved(getThreadAllocCounter())
+    {}
+
+    ~AllocPause() noexcept
+    {
+        setThreadAllocCounter(fSaved);
+    }
+
+private:
+    const AllocCounter fSaved;
+};
+
+END_NAMESPACE_DISTRHO
+
+#endif  // ALLOC_STATS_HPP
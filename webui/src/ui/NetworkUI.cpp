@@ -14,7 +14,9 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstring>
 #include <utility>
 #include <unistd.h>
@@ -24,13 +26,6 @@
 
 #if defined(DISTRHO_OS_WINDOWS)
 # include <Winsock2.h>
-# define IS_EADDRINUSE() (WSAGetLastError() == WSAEADDRINUSE) // errno==0
-# define CLOSE_SOCKET(s) closesocket(s)
-#else
-# include <arpa/inet.h>
-# include <sys/socket.h>
-# define IS_EADDRINUSE() (errno == EADDRINUSE)
-# define CLOSE_SOCKET(s) ::close(s)
 #endif
 
 #include "NetworkUI.hpp"
@@ -41,10 +36,24 @@
 #else
 # define TRANSFER_PROTOCOL "http"
 #endif
-#define FIRST_PORT 49152 // first in dynamic/private range
+
+// Raw binary frame layout for streamed shared memory writes, see dpf.js:
+// uint32 marker 0xffffffff (never a valid BSON document size), int32 djb2 hash
+// of "writeSharedMemory", uint32 offset, followed by the data. Little endian.
+#define STREAM_MARKER      0xffffffff
+#define STREAM_HEADER_SIZE 12
 
 USE_NAMESPACE_DISTRHO
 
+// All plugin instances in the process share a single server, service thread
+// and listening port. Clients select an instance through the URL.
+static Mutex            gServerMutex;
+static WebServer*       gServer = nullptr;
+static WebServerThread* gServerThread = nullptr;
+static AddressCache*    gAddressCache = nullptr;
+static int              gServerRefCount = 0;
+static int              gLastServerPort = -1; // survives server restarts
+
 NetworkUI::NetworkUI(uint widthCssPx, uint heightCssPx, float initPixelRatio)
     : WebUIBase(widthCssPx, heightCssPx, initPixelRatio
 #if DPF_WEBUI_PROTOCOL_BINARY
@@ -53,7 +62,9 @@ NetworkUI::NetworkUI(uint widthCssPx, uint heightCssPx, float initPixelRatio)
     )
     , fServerInit(false)
     , fPort(-1)
-    , fThread(nullptr)
+    , fServer(nullptr)
+    , fInstance(0)
+    , fWebViewClient(nullptr)
 #if DPF_WEBUI_ZEROCONF
     , fZeroconfPublish(false)
 #endif
@@ -75,19 +86,17 @@ NetworkUI::NetworkUI(uint widthCssPx, uint heightCssPx, float initPixelRatio)
     setBuiltInFunctionHandlers();
 
     if ((! DISTRHO_PLUGIN_WANT_STATE) || isStandalone()) {
-        // Port is not remembered when state support is disabled
-        fPort = findAvailablePort();
-        if (fPort != -1) {
-            initServer();
-        }
+        // Port is only remembered during process lifetime without state support
+        initServer();
     }
 }
 
 NetworkUI::~NetworkUI()
 {
-    if (fThread != nullptr) {
-        delete fThread;
-        fThread = nullptr;
+    if (fServer != nullptr) {
+        fServer->removeHandler(fInstance);
+        fServer = nullptr;
+        releaseServer();
     }
 #if defined(DISTRHO_OS_WINDOWS)
     //WSACleanup();
@@ -96,43 +105,17 @@ NetworkUI::~NetworkUI()
 
 String NetworkUI::getLocalUrl()
 {
-    return String(TRANSFER_PROTOCOL "://127.0.0.1:") + String(fPort);
+    return String(TRANSFER_PROTOCOL "://127.0.0.1:") + String(fPort) + getInstancePath();
 }
 
 String NetworkUI::getPublicUrl()
 {
-    String url = getLocalUrl();
-
-    const int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd == -1) {
-        d_stderr(LOG_TAG " : failed socket(), errno %d", errno);
-        return url;
+    if (fServer == nullptr) {
+        return getLocalUrl();
     }
 
-    sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = inet_addr("8.8.8.8"); // Google DNS
-    addr.sin_port = htons(53);
-
-    if (connect(sockfd, (const sockaddr*)&addr, sizeof(addr)) == 0) {
-        socklen_t addrlen = sizeof(addr);
-
-        if (getsockname(sockfd, (sockaddr*)&addr, &addrlen) == 0) {
-            const char* ip = inet_ntoa(addr.sin_addr);
-            url = String(TRANSFER_PROTOCOL "://") + ip + ":" + String(fPort);
-        } else {
-            d_stderr(LOG_TAG " : failed getsockname(), errno %d", errno);
-        }
-    } else {
-        //d_stderr(LOG_TAG " : failed connect(), errno %d", errno);
-    }
-
-    if (CLOSE_SOCKET(sockfd) == -1) {
-        d_stderr(LOG_TAG " : failed close(), errno %d", errno);
-    }
-
-    return url;
+    return String(TRANSFER_PROTOCOL "://") + gAddressCache->getAddress() + ":" + String(fPort)
+        + getInstancePath();
 }
 
 void NetworkUI::setState(const char* key, const char* value)
@@ -140,50 +123,59 @@ void NetworkUI::setState(const char* key, const char* value)
     // Warning : UI::setState() is non-virtual !
     WebUIBase::setState(key, value);
     fStates[key] = value;
+    fStateVersions[key]++; // not broadcast, invalidates client copies
+}
+
+void NetworkUI::setParameterEchoResolution(uint32_t index, float minimum, float maximum,
+                                            float epsilon)
+{
+    ParameterEchoFilter& filter = fParameterEchoFilters[index];
+    filter.minimum = std::min(minimum, maximum);
+    filter.maximum = std::max(minimum, maximum);
+    filter.step = epsilon * (filter.maximum - filter.minimum);
+    filter.lastValue = 0;
+    filter.sent = false;
 }
 
 void NetworkUI::postMessage(const Variant& payload, uintptr_t destination, uintptr_t exclude)
 {
+    if (fServer == nullptr) {
+        return;
+    }
+
+    const Client webViewClient = fWebViewClient;
+    const Client excludeClient = exclude == kDestinationWebView ? webViewClient
+                                    : reinterpret_cast<Client>(exclude);
 #if DPF_WEBUI_PROTOCOL_BINARY
     BinaryData data = payload.toBSON();
     if (destination == kDestinationAll) {
-        if (exclude == kDestinationWebView) {
-            String userAgent(kWebViewUserAgent);
-            Client excClient = fServer.getClientByUserAgentComponent(userAgent);
-            fServer.broadcast(data.data(), data.size(), excClient);
-        } else {
-            fServer.broadcast(data.data(), data.size());
-        }
+        fServer->broadcast(fInstance, data.data(), data.size(), excludeClient);
     } else if (destination == kDestinationWebView) {
-        String userAgent(kWebViewUserAgent);
-        Client client = fServer.getClientByUserAgentComponent(userAgent);
-        if (client != nullptr) {
-            fServer.send(data.data(), data.size(), client);
+        if (webViewClient != nullptr) {
+            fServer->send(data.data(), data.size(), webViewClient);
         }
     } else {
-        fServer.send(data.data(), data.size(), reinterpret_cast<Client>(destination));
+        fServer->send(data.data(), data.size(), reinterpret_cast<Client>(destination));
     }
 #else
     if (destination == kDestinationAll) {
-        if (exclude == kDestinationWebView) {
-            String userAgent(kWebViewUserAgent);
-            Client excClient = fServer.getClientByUserAgentComponent(userAgent);
-            fServer.broadcast(payload.toJSON(), excClient);
-        } else {
-            fServer.broadcast(payload.toJSON());
-        }
+        fServer->broadcast(fInstance, payload.toJSON(), excludeClient);
     } else if (destination == kDestinationWebView) {
-        String userAgent(kWebViewUserAgent);
-        Client client = fServer.getClientByUserAgentComponent(userAgent);
-        if (client != nullptr) {
-            fServer.send(payload.toJSON(), client);
+        if (webViewClient != nullptr) {
+            fServer->send(payload.toJSON(), webViewClient);
         }
     } else {
-        fServer.send(payload.toJSON(), reinterpret_cast<Client>(destination));
+        fServer->send(payload.toJSON(), reinterpret_cast<Client>(destination));
     }
 #endif
 }
 
+void NetworkUI::uiIdle()
+{
+    WebUIBase::uiIdle();
+    flushParameterEchoes();
+}
+
 void NetworkUI::parameterChanged(uint32_t index, float value)
 {
     fParameters[index] = value;
@@ -191,7 +183,7 @@ void NetworkUI::parameterChanged(uint32_t index, float value)
     if (fParameterLock) {
         fParameterLock = false;
     } else {
-        WebUIBase::parameterChanged(index, value);
+        fParameterEchoes[index] = { value, kExcludeNone, getTimeMs() };
     }
 }
 
@@ -204,14 +196,11 @@ void NetworkUI::stateChanged(const char* key, const char* value)
 
     if ((std::strcmp(key, "_ws_port") == 0) && ! fServerInit) {
         fPort = std::atoi(value);
-        if (fPort == -1) {
-            fPort = findAvailablePort();
+        const int savedPort = fPort;
+        initServer();
+        if ((fPort != -1) && (fPort != savedPort)) {
+            // Server was already running, saved port was taken or not set
             setState("_ws_port", std::to_string(fPort).c_str());
-        } else {
-            //d_stderr(LOG_TAG " : reusing port %d", fPort);
-        }
-        if (fPort != -1) {
-            initServer();
         }
         return;
     }
@@ -239,9 +228,11 @@ void NetworkUI::stateChanged(const char* key, const char* value)
     }
 # endif
 
-    fStates[key] = value;
+    std::string& state = fStates[key];
+    const std::string base = std::move(state);
+    state = value;
 
-    WebUIBase::stateChanged(key, value);
+    broadcastState(key, base, state, kExcludeNone);
 }
 #endif
 
@@ -250,6 +241,15 @@ void NetworkUI::onClientConnected(Client client)
     (void)client;
 }
 
+void NetworkUI::setWebViewClient(Client client)
+{
+    if (fServer != nullptr) {
+        fServer->setClientRole(client, kClientRoleWebView);
+    }
+
+    fWebViewClient = client;
+}
+
 void NetworkUI::setBuiltInFunctionHandlers()
 {
     // Broadcast parameter updates to all clients except the originating one
@@ -259,11 +259,10 @@ void NetworkUI::setBuiltInFunctionHandlers()
             const uint32_t index = static_cast<uint32_t>(args[0].getNumber());
             const float value = static_cast<float>(args[1].getNumber());
             fParameters[index] = value;
+            fParameterEchoes[index] = { value, origin, getTimeMs() };
             fParameterLock = true; // avoid echo
             parameterHandlerSuper(args, origin);
         });
-
-        callback("parameterChanged", args, kDestinationAll, /*exclude*/origin);
     });
 
 #if DISTRHO_PLUGIN_WANT_STATE
@@ -272,12 +271,28 @@ void NetworkUI::setBuiltInFunctionHandlers()
     setFunctionHandler("setState", 2, [this, stateHandlerSuper](const Variant& args, uintptr_t origin) {
         queue([this, stateHandlerSuper, args, origin] {
             const String key = args[0].getString();
-            const String value = args[1].getString();
-            fStates[key.buffer()] = value.buffer();
+            std::string& state = fStates[key.buffer()];
+            const std::string base = std::move(state);
+            state = args[1].getString().buffer();
             stateHandlerSuper(args, origin);
+            broadcastState(key.buffer(), base, state, /*exclude*/origin);
+            // The originating client already holds the value, it only needs
+            // the version for applying later deltas
+            const double version = static_cast<double>(fStateVersions[key.buffer()]);
+            callback("stateAcknowledged", { key, version }, origin);
         });
+    });
 
-        callback("stateChanged", args, kDestinationAll, /*exclude*/origin);
+    // Clients ask for the full value when a state delta does not apply
+    setFunctionHandler("requestState", 1, [this](const Variant& args, uintptr_t origin) {
+        queue([this, args, origin] {
+            const String key = args[0].getString();
+            StateMap::const_iterator it = fStates.find(key.buffer());
+            if (it != fStates.cend()) {
+                const double version = static_cast<double>(fStateVersions[it->first]);
+                callback("stateChanged", { key, it->second.c_str(), version }, origin);
+            }
+        });
     });
 #endif
 
@@ -324,6 +339,35 @@ void NetworkUI::setBuiltInFunctionHandlers()
         callback("getPublicUrl", { getPublicUrl() }, origin);
     });
 
+    setFunctionHandler("getServerStats", 0, [this](const Variant&, uintptr_t origin) {
+        Variant stats = Variant::createArray();
+
+        if (fServer != nullptr) {
+            const ClientInfoVector info = fServer->getClientInfo(fInstance);
+
+            for (ClientInfoVector::const_iterator it = info.cbegin(); it != info.cend(); ++it) {
+                const ClientStats& st = it->stats;
+                stats.pushArrayItem(Variant::createObject({
+                    { "role"            , getClientRoleName(it->role) },
+                    { "address"         , it->address },
+                    { "self"            , it->client == reinterpret_cast<Client>(origin) },
+                    { "queueDepth"      , static_cast<double>(it->queueDepth) },
+                    { "bytesSent"       , static_cast<double>(st.bytesSent) },
+                    { "bytesReceived"   , static_cast<double>(st.bytesReceived) },
+                    { "messagesSent"    , static_cast<double>(st.messagesSent) },
+                    { "messagesReceived", static_cast<double>(st.messagesReceived) },
+                    { "messagesDropped" , static_cast<double>(st.messagesDropped) },
+                    { "sendRate"        , st.sendRate },
+                    { "receiveRate"     , st.receiveRate },
+                    { "rtt"             , st.rtt },
+                    { "pingTimeouts"    , static_cast<double>(st.pingTimeouts) }
+                }));
+            }
+        }
+
+        callback("getServerStats", { stats }, origin);
+    });
+
     setFunctionHandler("ping", 0, [this](const Variant&, uintptr_t origin) {
         callback("pong", Variant::createArray(), origin);
     });
@@ -332,57 +376,210 @@ void NetworkUI::setBuiltInFunctionHandlers()
 void NetworkUI::initServer()
 {
     fServerInit = true;
-    fServer.init(fPort, this);
-    fThread = new WebServerThread(&fServer);
-    d_stderr(LOG_TAG " : server up @ %s", getPublicUrl().buffer());
+    fServer = acquireServer(fPort);
+
+    if (fServer != nullptr) {
+        fInstance = fServer->addHandler(this);
+        d_stderr(LOG_TAG " : instance up @ %s", getPublicUrl().buffer());
+    }
 }
 
-int NetworkUI::findAvailablePort()
+String NetworkUI::getInstancePath()
 {
-    // Ports are not reused during process lifetime unless SO_REUSEADDR is set.
-    // Once a plugin binds to a port it is safe to assume that other plugin
-    // instances will not claim the same port. A single plugin can reuse a port
-    // by enabling DISTRHO_PLUGIN_WANT_STATE so it can be stored in a DPF state.
+    return String("/?instance=") + String(fInstance);
+}
 
-    const int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd == -1) {
-        d_stderr(LOG_TAG " : failed socket(), errno %d", errno);
-        return -1;
+void NetworkUI::flushParameterEchoes()
+{
+    if (fParameterEchoes.empty()) {
+        return;
     }
 
-    sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
+    // Coalesce all updates since last idle into a single message per origin,
+    // each origin already knows the values it sent and is excluded.
+    typedef std::map<uintptr_t, Variant> BatchMap;
+    BatchMap batches;
+    const int64_t now = getTimeMs();
 
-    int port = -1, i = FIRST_PORT;
+    for (ParameterEchoMap::iterator it = fParameterEchoes.begin(); it != fParameterEchoes.end();) {
+        if (filterParameterEcho(it->first, it->second, now)) {
+            ++it;
+            continue;
+        }
 
-    while ((port == -1) && (i < 65535)) {
-        addr.sin_port = htons(i);
+        BatchMap::iterator batch = batches.find(it->second.origin);
+        if (batch == batches.end()) {
+            batch = batches.emplace(it->second.origin, Variant::createArray()).first;
+        }
+
+        batch->second.pushArrayItem(it->first);
+        batch->second.pushArrayItem(it->second.value);
+        it = fParameterEchoes.erase(it);
+    }
 
-        if (bind(sockfd, (const sockaddr*)&addr, sizeof(addr)) == 0) {
-            port = i;
+    for (BatchMap::const_iterator it = batches.cbegin(); it != batches.cend(); ++it) {
+        if (it->second.getArraySize() == 2) {
+            callback("parameterChanged", it->second, kDestinationAll, /*exclude*/it->first);
         } else {
-            if (IS_EADDRINUSE()) {
-                i++;
-            } else {
-                d_stderr(LOG_TAG " : failed bind(), errno %d", errno);
-                break;
-            }
+            callback("parameterChangedBatch", it->second, kDestinationAll, /*exclude*/it->first);
         }
     }
+}
 
-    if (CLOSE_SOCKET(sockfd) == -1) {
-        d_stderr(LOG_TAG " : failed close(), errno %d", errno);
+// Returns true if the echo should be held back for now. Small moves made by
+// a client are held until they add up to a full step or the value settles.
+bool NetworkUI::filterParameterEcho(uint32_t index, const ParameterEcho& echo, int64_t now)
+{
+    ParameterEchoFilterMap::iterator it = fParameterEchoFilters.find(index);
+    if (it == fParameterEchoFilters.end()) {
+        return false;
     }
 
-    if (port == -1) {
-        d_stderr2(LOG_TAG " : could not find available port");
-    } else {
-        //d_stderr(LOG_TAG " : found available port %d", port);
+    ParameterEchoFilter& filter = it->second;
+    const float value = echo.value;
+
+    if ((echo.origin != kExcludeNone) && filter.sent && (value > filter.minimum) && (value < filter.maximum)
+            && (std::fabs(value - filter.lastValue) < filter.step)
+            && ((now - echo.time) < DPF_WEBUI_PARAMETER_SETTLE_MS)) {
+        return true;
+    }
+
+    filter.lastValue = value;
+    filter.sent = true;
+
+    return false;
+}
+
+int64_t NetworkUI::getTimeMs() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if DISTRHO_PLUGIN_WANT_STATE
+static bool isUtf8Continuation(char c)
+{
+    return (static_cast<unsigned char>(c) & 0xc0) == 0x80;
+}
+
+// JavaScript strings are indexed in UTF-16 code units
+static size_t utf16Length(const char* s, size_t size)
+{
+    size_t length = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        const unsigned char c = static_cast<unsigned char>(s[i]);
+        if ((c & 0xc0) != 0x80) {
+            length += c >= 0xf0 ? 2 : 1; // 4-byte sequences need a surrogate pair
+        }
     }
 
-    return port;
+    return length;
+}
+
+void NetworkUI::broadcastState(const char* key, const std::string& base, const std::string& value,
+                                uintptr_t exclude)
+{
+    // Clients only apply a delta to the exact value it was computed against,
+    // equal lengths do not guarantee equal contents
+    uint32_t& versionRef = fStateVersions[key];
+    const uint32_t baseVersion = versionRef++;
+    const double version = static_cast<double>(versionRef);
+
+    if ((DPF_WEBUI_STATE_DELTA_MIN_SIZE == 0) || (value.size() < DPF_WEBUI_STATE_DELTA_MIN_SIZE)
+            || base.empty()) {
+        callback("stateChanged", { key, value.c_str(), version }, kDestinationAll, exclude);
+        return;
+    }
+
+    // Replace the span between the common prefix and suffix, without
+    // splitting multibyte characters
+    const size_t maxPrefix = std::min(base.size(), value.size());
+    size_t prefix = 0;
+
+    while ((prefix < maxPrefix) && (base[prefix] == value[prefix])) {
+        prefix++;
+    }
+
+    while ((prefix > 0) && (((prefix < base.size()) && isUtf8Continuation(base[prefix]))
+            || ((prefix < value.size()) && isUtf8Continuation(value[prefix])))) {
+        prefix--;
+    }
+
+    const size_t maxSuffix = maxPrefix - prefix;
+    size_t suffix = 0;
+
+    while ((suffix < maxSuffix)
+            && (base[base.size() - 1 - suffix] == value[value.size() - 1 - suffix])) {
+        suffix++;
+    }
+
+    while ((suffix > 0) && isUtf8Continuation(value[value.size() - suffix])) {
+        suffix--;
+    }
+
+    const size_t insertSize = value.size() - prefix - suffix;
+
+    if (insertSize >= value.size() / 2) {
+        callback("stateChanged", { key, value.c_str(), version }, kDestinationAll, exclude);
+        return;
+    }
+
+    const std::string insert = value.substr(prefix, insertSize);
+    const Variant args = {
+        key,
+        static_cast<double>(utf16Length(value.data(), prefix)),
+        static_cast<double>(utf16Length(base.data() + prefix, base.size() - prefix - suffix)),
+        insert.c_str(),
+        static_cast<double>(baseVersion),
+        version
+    };
+
+    callback("stateChangedDelta", args, kDestinationAll, exclude);
+}
+#endif
+
+WebServer* NetworkUI::acquireServer(int& port)
+{
+    const MutexLocker serverScopedLock(gServerMutex);
+
+    if (gServer == nullptr) {
+        // Port saved in state or used earlier during the process lifetime,
+        // the server falls back to a system assigned port if not available.
+        WebServer* server = new WebServer();
+
+        if (server->init(port != -1 ? port : gLastServerPort, kWebViewUserAgent) == -1) {
+            delete server;
+            return nullptr;
+        }
+
+        gServer = server;
+        gServerThread = new WebServerThread(gServer);
+        gAddressCache = new AddressCache();
+        gLastServerPort = gServer->getPort();
+        d_stderr(LOG_TAG " : server up on port %d", gLastServerPort);
+    }
+
+    gServerRefCount++;
+    port = gServer->getPort();
+
+    return gServer;
+}
+
+void NetworkUI::releaseServer()
+{
+    const MutexLocker serverScopedLock(gServerMutex);
+
+    if (--gServerRefCount > 0) {
+        return;
+    }
+
+    delete gAddressCache;
+    gAddressCache = nullptr;
+    delete gServerThread;
+    gServerThread = nullptr;
+    delete gServer;
+    gServer = nullptr;
 }
 
 #if DPF_WEBUI_ZEROCONF
@@ -391,7 +588,8 @@ void NetworkUI::zeroconfStateUpdated()
     if (fZeroconfPublish && ! fZeroconfId.isEmpty() && ! fZeroconfName.isEmpty()) {
         fZeroconf.publish(fZeroconfName, "_http._tcp", fPort, {
             { "dpfuri", DISTRHO_PLUGIN_URI },
-            { "instanceid", fZeroconfId } // ID is useless unless plugin state is made persistent
+            { "instanceid", fZeroconfId }, // ID is useless unless plugin state is made persistent
+            { "path", getInstancePath() }  // server is shared by all instances in the process
         });
     } else {
         fZeroconf.unpublish();
@@ -399,8 +597,13 @@ void NetworkUI::zeroconfStateUpdated()
 }
 #endif
 
-void NetworkUI::handleWebServerConnect(Client client)
+void NetworkUI::handleWebServerConnect(Client client, ClientRole role)
 {
+    // Routing to and from the embedded web view becomes a pointer comparison
+    if (role == kClientRoleWebView) {
+        fWebViewClient = client;
+    }
+
     queue([this, client] {
         // Send all current parameters and states
         for (ParameterMap::const_iterator it = fParameters.cbegin(); it != fParameters.cend(); ++it) {
@@ -409,7 +612,8 @@ void NetworkUI::handleWebServerConnect(Client client)
         }
 
         for (StateMap::const_iterator it = fStates.cbegin(); it != fStates.cend(); ++it) {
-            const Variant args = { it->first.c_str(), it->second.c_str() };
+            const double version = static_cast<double>(fStateVersions[it->first]);
+            const Variant args = { it->first.c_str(), it->second.c_str(), version };
             callback("stateChanged", args, reinterpret_cast<uintptr_t>(client));
         }
 
@@ -417,6 +621,15 @@ void NetworkUI::handleWebServerConnect(Client client)
     });
 }
 
+void NetworkUI::handleWebServerDisconnect(Client client)
+{
+    Client webViewClient = client;
+    fWebViewClient.compare_exchange_strong(webViewClient, nullptr);
+#if DPF_WEBUI_STREAM_SHARED_MEMORY
+    fUploads.erase(client);
+#endif
+}
+
 int NetworkUI::handleWebServerRead(Client client, const ByteVector& data)
 {
 #if DPF_WEBUI_PROTOCOL_BINARY
@@ -439,6 +652,75 @@ int NetworkUI::handleWebServerRead(Client client, const char* data)
     return 0;
 }
 
+#if DPF_WEBUI_STREAM_SHARED_MEMORY
+static uint32_t readUInt32LE(const uint8_t* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+        | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static_assert(STREAM_HEADER_SIZE <= kStreamProbeSize, "Stream header must fit in the probe");
+
+bool NetworkUI::handleWebServerStreamBegin(Client client, const uint8_t* data, size_t size)
+{
+    // The header is always complete here unless the whole message is shorter
+    if ((size < STREAM_HEADER_SIZE) || (readUInt32LE(data) != STREAM_MARKER)) {
+        return false;
+    }
+
+    if (static_cast<int32_t>(readUInt32LE(data + 4)) != djb2hash("writeSharedMemory")) {
+        return false;
+    }
+
+    SharedMemoryUpload& upload = fUploads[client];
+    upload.skip = STREAM_HEADER_SIZE;
+    upload.offset = readUInt32LE(data + 8);
+    upload.size = 0;
+    upload.valid = true;
+
+    return true;
+}
+
+int NetworkUI::handleWebServerStream(Client client, const uint8_t* data, size_t size, bool final)
+{
+    SharedMemoryUpload& upload = fUploads[client];
+
+    const size_t skip = upload.skip < size ? upload.skip : size;
+    upload.skip -= skip;
+    data += skip;
+    size -= skip;
+
+    const size_t pos = upload.offset + upload.size;
+    uint8_t* ptr = getSharedMemoryPointer(); // atomic, the UI thread may be creating it
+
+    if ((ptr == nullptr) || (pos > DPF_WEBUI_SHARED_MEMORY_SIZE)
+            || (size > DPF_WEBUI_SHARED_MEMORY_SIZE - pos)) {
+        upload.valid = false;
+    }
+
+    if (upload.valid) {
+        std::memcpy(ptr + pos, data, size);
+        upload.size += size;
+    }
+
+    if (final) {
+        if (upload.valid) {
+            const size_t offset = upload.offset;
+            const size_t written = upload.size;
+            queue([this, written, offset] {
+                notifySharedMemoryWritten(written, offset);
+            });
+        } else {
+            d_stderr2(LOG_TAG " : shared memory write out of bounds");
+        }
+
+        fUploads.erase(client);
+    }
+
+    return 0;
+}
+#endif // DPF_WEBUI_STREAM_SHARED_MEMORY
+
 int32_t NetworkUI::djb2hash(const char* str)
 {
     int32_t h = 5381;
@@ -17,11 +17,14 @@
 #ifndef NETWORK_UI_HPP
 #define NETWORK_UI_HPP
 
+#include <atomic>
+#include <map>
 #include <string>
 #include <unordered_map>
 
 #include "distrho/extra/Thread.hpp"
 
+#include "AddressCache.hpp"
 #include "WebUIBase.hpp"
 #include "WebServer.hpp"
 #include "Variant.hpp"
@@ -29,6 +32,26 @@
 # include "Zeroconf.hpp"
 #endif
 
+// Shared memory writes from network clients bypass the BSON message path and
+// are copied straight into the shared memory region as the frame arrives
+#if DPF_WEBUI_PROTOCOL_BINARY && DISTRHO_PLUGIN_WANT_STATE && defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
+# define DPF_WEBUI_STREAM_SHARED_MEMORY 1
+#else
+# define DPF_WEBUI_STREAM_SHARED_MEMORY 0
+#endif
+
+// State values at least this long are sent to network clients as a splice
+// against the previous value when only a small part changed, 0 disables it
+#ifndef DPF_WEBUI_STATE_DELTA_MIN_SIZE
+# define DPF_WEBUI_STATE_DELTA_MIN_SIZE 256
+#endif
+
+// Filtered parameter echoes are delivered anyway once updates stop arriving
+// for this amount of time, so clients always end up with the final value
+#ifndef DPF_WEBUI_PARAMETER_SETTLE_MS
+# define DPF_WEBUI_PARAMETER_SETTLE_MS 50
+#endif
+
 START_NAMESPACE_DISTRHO
 
 class WebServerThread;
@@ -39,7 +62,8 @@ public:
     NetworkUI(uint widthCssPx, uint heightCssPx, float initPixelRatio);
     virtual ~NetworkUI();
 
-    WebServer& getServer() { return fServer; }
+    WebServer* getServer() noexcept { return fServer; }
+    int        getInstance() const noexcept { return fInstance; }
 
     String getLocalUrl();
     String getPublicUrl();
@@ -47,8 +71,16 @@ public:
 protected:
     void setState(const char* key, const char* value);
 
+    // Only broadcast changes made by clients of at least epsilon * (maximum -
+    // minimum) since the last value sent. Range endpoints and changes coming
+    // from the host, like automation, are never filtered.
+    void setParameterEchoResolution(uint32_t index, float minimum, float maximum,
+                                    float epsilon = 0.005f);
+
     void postMessage(const Variant& payload, uintptr_t destination, uintptr_t exclude) override;
 
+    void uiIdle() override;
+
     void parameterChanged(uint32_t index, float value) override;
 #if DISTRHO_PLUGIN_WANT_STATE
     void stateChanged(const char* key, const char* value) override;
@@ -56,24 +88,44 @@ protected:
 
     virtual void onClientConnected(Client client);
 
+    void setWebViewClient(Client client);
+
 private:
     void setBuiltInFunctionHandlers();
     void initServer();
-    int  findAvailablePort();
+    String getInstancePath();
+
+    struct ParameterEcho;
+    void flushParameterEchoes();
+    bool filterParameterEcho(uint32_t index, const ParameterEcho& echo, int64_t now);
+    static int64_t getTimeMs() noexcept;
+#if DISTRHO_PLUGIN_WANT_STATE
+    void broadcastState(const char* key, const std::string& base, const std::string& value,
+                        uintptr_t exclude);
+#endif
+
+    static WebServer* acquireServer(int& port);
+    static void       releaseServer();
 #if DPF_WEBUI_ZEROCONF
     void zeroconfStateUpdated();
 #endif
 
-    void handleWebServerConnect(Client client) override;
+    void handleWebServerConnect(Client client, ClientRole role) override;
+    void handleWebServerDisconnect(Client client) override;
     int  handleWebServerRead(Client client, const ByteVector& data) override;
     int  handleWebServerRead(Client client, const char* data) override;
+#if DPF_WEBUI_STREAM_SHARED_MEMORY
+    bool handleWebServerStreamBegin(Client client, const uint8_t* data, size_t size) override;
+    int  handleWebServerStream(Client client, const uint8_t* data, size_t size, bool final) override;
+#endif
 
     static int32_t djb2hash(const char *str);
 
     bool             fServerInit;
     int              fPort;
-    WebServer        fServer;
-    WebServerThread* fThread;
+    WebServer*       fServer;
+    int              fInstance;
+    std::atomic<Client> fWebViewClient;
 #if DPF_WEBUI_ZEROCONF
     Zeroconf fZeroconf;
     bool     fZeroconfPublish;
@@ -83,8 +135,39 @@ private:
     typedef std::unordered_map<uint32_t, float> ParameterMap;
     ParameterMap fParameters;
     bool         fParameterLock;
+    struct ParameterEcho
+    {
+        float     value;
+        uintptr_t origin;
+        int64_t   time;
+    };
+    typedef std::map<uint32_t, ParameterEcho> ParameterEchoMap;
+    ParameterEchoMap fParameterEchoes; // pending until next idle, UI thread only
+    struct ParameterEchoFilter
+    {
+        float minimum;
+        float maximum;
+        float step;
+        float lastValue;
+        bool  sent;
+    };
+    typedef std::unordered_map<uint32_t, ParameterEchoFilter> ParameterEchoFilterMap;
+    ParameterEchoFilterMap fParameterEchoFilters;
     typedef std::unordered_map<std::string, std::string> StateMap;
     StateMap     fStates;
+    typedef std::unordered_map<std::string, uint32_t> StateVersionMap;
+    StateVersionMap fStateVersions; // bumped on every change, identifies delta bases
+#if DPF_WEBUI_STREAM_SHARED_MEMORY
+    struct SharedMemoryUpload
+    {
+        size_t skip;   // header bytes not consumed yet
+        size_t offset;
+        size_t size;
+        bool   valid;
+    };
+    typedef std::unordered_map<Client, SharedMemoryUpload> SharedMemoryUploadMap;
+    SharedMemoryUploadMap fUploads; // only accessed from the lws thread
+#endif
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NetworkUI)
 
@@ -15,11 +15,15 @@
  */
 
 #include <cstring>
+#include <new>
 
 #include "extra/UIEx.hpp"
 
 UIEx::UIEx(uint width, uint height)
     : UI(width, height)
+#if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
+    , fMemoryData(nullptr)
+#endif
 {}
 
 UIEx::~UIEx()
@@ -32,36 +36,98 @@ UIEx::~UIEx()
 #if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
 uint8_t* UIEx::getSharedMemoryPointer() const noexcept
 {
-    return fMemory.getDataPointer();
+    return fMemoryData.load(std::memory_order_acquire);
+}
+
+const char* UIEx::getSharedMemoryName() const noexcept
+{
+    return fMemory.getDataFilename();
 }
 
 bool UIEx::writeSharedMemory(const uint8_t* data, size_t size, size_t offset) noexcept
 {
-    uint8_t* ptr = fMemory.getDataPointer();
+    uint8_t* ptr = getSharedMemoryPointer();
 
-    if (ptr == nullptr) {
+    if ((ptr == nullptr) || (offset > DPF_WEBUI_SHARED_MEMORY_SIZE)
+            || (size > DPF_WEBUI_SHARED_MEMORY_SIZE - offset)) {
         return false;
     }
 
     std::memcpy(ptr + offset, data, size);
-
-    String metadata = String(size) + String(';') + String(offset);
-    setState("_shmem_data", metadata.buffer());
+    notifySharedMemoryWritten(size, offset);
 
     return true;
 }
 
+void UIEx::notifySharedMemoryWritten(size_t size, size_t offset)
+{
+    // Allows writers that fill the shared memory in place, like streamed
+    // network uploads, to skip the intermediate copy of writeSharedMemory()
+    SharedMemoryHeader* header = getSharedMemoryHeader();
+
+    if ((header != nullptr) && header->consumerActive.load(std::memory_order_acquire)
+            && header->commands.push(static_cast<uint32_t>(offset), static_cast<uint32_t>(size))) {
+        return; // PluginEx::processSharedMemoryCommands()
+    }
+
+    // Plugin does not drain the queue, or it is full because the host stopped
+    // calling run()
+    String metadata = String(size) + String(';') + String(offset);
+    setState("_shmem_data", metadata.buffer()); // PluginEx::sharedMemoryWritten()
+}
+
 void UIEx::notifySharedMemoryWillDisconnect()
 {
     setState("_shmem_file", "close"); // PluginEx::sharedMemoryWillDisconnect()
 }
 
+uint8_t* UIEx::createSharedMemoryRegion(const char* name, size_t size) noexcept
+{
+    SharedMemoryHeader* header = getSharedMemoryHeader();
+    return header != nullptr ? header->createRegion(name, size) : nullptr;
+}
+
+uint8_t* UIEx::getSharedMemoryRegion(const char* name, size_t* size) const noexcept
+{
+    SharedMemoryHeader* header = getSharedMemoryHeader();
+    return header != nullptr ? header->findRegion(name, size) : nullptr;
+}
+
+uint8_t* UIEx::resizeSharedMemoryRegion(const char* name, size_t size) noexcept
+{
+    SharedMemoryHeader* header = getSharedMemoryHeader();
+    return header != nullptr ? header->resizeRegion(name, size) : nullptr;
+}
+
+bool UIEx::removeSharedMemoryRegion(const char* name) noexcept
+{
+    SharedMemoryHeader* header = getSharedMemoryHeader();
+    return header != nullptr ? header->regions.remove(name) : false;
+}
+
+uint32_t UIEx::getSharedMemoryRegionsVersion() const noexcept
+{
+    SharedMemoryHeader* header = getSharedMemoryHeader();
+    return header != nullptr ? header->regions.getVersion() : 0;
+}
+
 void UIEx::uiIdle()
 {
     // setState() fails for VST3 when called from constructor
-    if (! fMemory.isCreatedOrConnected() && fMemory.create()) {
+    if (! fMemory.isCreatedOrConnected() && fMemory.create(kSharedMemoryCreateFlags)) {
+        new (fMemory.getDataPointer()) SharedMemoryHeader(DPF_WEBUI_SHARED_MEMORY_SIZE);
+        uint8_t* ptr = fMemory.getDataPointer() + kSharedMemoryDataOffset;
+        // Regions created by sharedMemoryCreated() are visible to the plugin
+        // by the time PluginEx::sharedMemoryConnected() is called
+        sharedMemoryCreated(ptr);
+        // Other threads, like the network server one, can use it from now on
+        fMemoryData.store(ptr, std::memory_order_release);
         setState("_shmem_file", fMemory.getDataFilename());
-        sharedMemoryCreated(fMemory.getDataPointer());
     }
 }
+
+SharedMemoryHeader* UIEx::getSharedMemoryHeader() const noexcept
+{
+    return reinterpret_cast<SharedMemoryHeader*>(fMemory.getDataPointer());
+}
 #endif // DPF_WEBUI_SHARED_MEMORY_SIZE
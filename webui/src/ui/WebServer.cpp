@@ -14,28 +14,51 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
+#include <utility>
 
 #include "WebServer.hpp"
 
+#if defined(DPF_WEBUI_NETWORK_STATS) && ! defined(DISTRHO_OS_WINDOWS)
+# include <sys/resource.h>
+#endif
+
 // Keep this include after WebServer.hpp to avoid warning from MinGW gcc:
 // "Please include winsock2.h before windows.h"
 #include "extra/Path.hpp"
 
+#define LOG_TAG "WebServer"
 #define LWS_PROTOCOL_NAME "lws-dpf"
+#define READ_BUFFER_RETAIN_SIZE   65536
+#define READ_BUFFER_RESERVE_LIMIT 16777216
+#define STATS_INTERVAL_US         2000000
+#define RTT_SMOOTHING             0.2
+#define PING_TIMEOUT_US           (2 * STATS_INTERVAL_US)
 
 USE_NAMESPACE_DISTRHO
 
 WebServer::WebServer()
     : fContext(nullptr)
-    , fHandler(nullptr)
+    , fVhost(nullptr)
+    , fPort(-1)
+#if defined(DPF_WEBUI_NETWORK_UNIX_SOCKET)
+    , fUnixVhost(nullptr)
+#endif
+    , fClients(std::make_shared<ClientContextMap>())
+    , fLastInstance(0)
 {}
 
 // JS injection feature currently not in use, leaving code just in case.
-void WebServer::init(int port, WebServerHandler* handler, const char* jsInjectTarget,
+// Returns the port the server is listening on or -1 on failure.
+int WebServer::init(int port, const char* webViewUserAgent, const char* jsInjectTarget,
                         const char* jsInjectToken)
 {
-    fHandler = handler;
+    if (webViewUserAgent != nullptr) {
+        fWebViewUserAgent = webViewUserAgent;
+    }
 
     lws_set_log_level(LLL_ERR|LLL_WARN/*|LLL_DEBUG*/, 0);
 
@@ -58,6 +81,24 @@ void WebServer::init(int port, WebServerHandler* handler, const char* jsInjectTa
     fMount.origin           = fMountOrigin;
     fMount.origin_protocol  = LWSMPRO_FILE;
     fMount.def              = "index.html";
+    fMount.mount_next       = &fInstancesMount;
+
+    // Lists the plugin instances served, see writeInstanceList()
+    std::memset(&fInstancesMount, 0, sizeof(fInstancesMount));
+    fInstancesMount.mountpoint      = "/instances";
+    fInstancesMount.mountpoint_len  = std::strlen(fInstancesMount.mountpoint);
+    fInstancesMount.origin          = LWS_PROTOCOL_NAME;
+    fInstancesMount.origin_protocol = LWSMPRO_CALLBACK;
+#if defined(DPF_WEBUI_NETWORK_STATS)
+    fInstancesMount.mount_next      = &fStatsMount;
+
+    // Server load and client telemetry for all instances, see writeStats()
+    std::memset(&fStatsMount, 0, sizeof(fStatsMount));
+    fStatsMount.mountpoint          = "/stats";
+    fStatsMount.mountpoint_len      = std::strlen(fStatsMount.mountpoint);
+    fStatsMount.origin              = LWS_PROTOCOL_NAME;
+    fStatsMount.origin_protocol     = LWSMPRO_CALLBACK;
+#endif
 
     if ((jsInjectTarget != nullptr) && (jsInjectToken != nullptr)) {
         fInjectToken = jsInjectToken;
@@ -74,7 +115,7 @@ void WebServer::init(int port, WebServerHandler* handler, const char* jsInjectTa
 #endif
 
     std::memset(&fContextInfo, 0, sizeof(fContextInfo));
-    fContextInfo.port       = port;
+    fContextInfo.port       = port > 0 ? port : 0;
     fContextInfo.protocols  = fProtocols;
     //fContextInfo.extensions = fExtensions;
     fContextInfo.mounts     = &fMount;
@@ -96,36 +137,140 @@ void WebServer::init(int port, WebServerHandler* handler, const char* jsInjectTa
     //fContextInfo.ssl_ca_filepath          = "/tmp/client-ca/ca.pem";
 #endif
 
+    // Listeners are created as separate virtual hosts sharing a single context
+    // and service thread, so a failed bind can be retried on another port.
+    fContextInfo.options |= LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
     fContext = lws_create_context(&fContextInfo);
+    if (fContext == nullptr) {
+        d_stderr2(LOG_TAG " : failed to create context");
+        return -1;
+    }
+
+    // Prefer the requested port, a previously used one is usually still free.
+    // Otherwise let the system pick a port, binding port 0 is atomic unlike
+    // probing for a free port and binding it later.
+    fVhost = lws_create_vhost(fContext, &fContextInfo);
+
+    if ((fVhost == nullptr) && (fContextInfo.port != 0)) {
+        fContextInfo.port = 0;
+        fVhost = lws_create_vhost(fContext, &fContextInfo);
+    }
+
+    if (fVhost == nullptr) {
+        d_stderr2(LOG_TAG " : failed to create TCP listener");
+        return -1;
+    }
+
+    fPort = lws_get_vhost_listen_port(fVhost);
+
+    // Periodic rate calculation and RTT probing, runs on the lws thread
+    std::memset(&fStatsTimer.sul, 0, sizeof(fStatsTimer.sul));
+    fStatsTimer.server = this;
+#if defined(DPF_WEBUI_NETWORK_STATS)
+    fLastCpuTime = getProcessCpuTimeUs();
+#endif
+    lws_sul_schedule(fContext, 0, &fStatsTimer.sul, WebServer::statsTimerCallback,
+                        STATS_INTERVAL_US);
+
+#if defined(DPF_WEBUI_NETWORK_UNIX_SOCKET)
+    createUnixSocketVhost(fPort);
+#endif
+
+    return fPort;
 }
 
+#if defined(DPF_WEBUI_NETWORK_UNIX_SOCKET)
+void WebServer::createUnixSocketVhost(int port)
+{
+    // Local clients that can speak HTTP over a Unix domain socket, like tools
+    // and scripts running on the same machine, skip the TCP loopback stack.
+    // Naming follows the TCP port so it is unique and easy to find.
+# if defined(DISTRHO_OS_LINUX)
+    String path = String("@dpfwebui-") + String(port);
+# else
+    const char* tmp = std::getenv("TMPDIR");
+    String path = String(tmp != nullptr ? tmp : "/tmp");
+    if (! path.endsWith('/')) {
+        path += "/";
+    }
+    path += String("dpfwebui-") + String(port) + ".sock";
+# endif
+
+    // lws keeps a reference to the interface string
+    fUnixSocketPath = path;
+
+    lws_context_creation_info info = fContextInfo;
+    info.port = 0; // unused for Unix domain sockets
+    info.iface = fUnixSocketPath;
+    info.vhost_name = "unix";
+    info.options |= LWS_SERVER_OPTION_UNIX_SOCK;
+
+    fUnixVhost = lws_create_vhost(fContext, &info);
+
+    if (fUnixVhost == nullptr) {
+        d_stderr2(LOG_TAG " : failed to create Unix domain socket listener %s", path.buffer());
+        fUnixSocketPath.clear();
+    }
+}
+#endif // DPF_WEBUI_NETWORK_UNIX_SOCKET
+
 WebServer::~WebServer()
 {
     if (fContext != nullptr) {
+        lws_sul_schedule(fContext, 0, &fStatsTimer.sul, nullptr, LWS_SET_TIMER_USEC_CANCEL);
         lws_context_destroy(fContext);
         fContext = nullptr;
     }
 }
 
-void WebServer::injectScript(const String& script)
+int WebServer::addHandler(WebServerHandler* handler)
 {
-    fInjectedScripts.push_back(script);
+    const MutexLocker handlerScopedLock(fHandlerMutex);
+
+    // IDs are not reused so stale clients can never reach a new instance
+    const int instance = ++fLastInstance;
+    fHandlers[instance] = handler;
+
+    return instance;
 }
 
-void WebServer::send(const uint8_t* data, size_t size, Client client, bool binary)
+void WebServer::removeHandler(int instance)
 {
-    ClientContextMap::iterator it = fClients.find(client);
-    if (it == fClients.end()) {
-        return;
+    {
+        const MutexLocker handlerScopedLock(fHandlerMutex);
+        fHandlers.erase(instance);
     }
 
-    ClientContext::FrameData frame(binary);
-    frame.data.insert(frame.data.end(), data, data + size);
-
+    // Disconnect clients of the removed instance, handleWrite() closes them
+    const ClientContextMapPtr clients = getClients();
     const MutexLocker writeBufferScopedLock(fMutex);
-    it->second.writeBuffer.push_back(frame);
 
-    lws_callback_on_writable(client);
+    for (ClientContextMap::const_iterator it = clients->cbegin(); it != clients->cend(); ++it) {
+        if ((it->second->instance == instance) && ! it->second->closed) {
+            it->second->closed = true;
+            it->second->writeBuffer.clear();
+            lws_callback_on_writable(it->first);
+        }
+    }
+
+    if (fContext != nullptr) {
+        lws_cancel_service(fContext);
+    }
+}
+
+void WebServer::injectScript(const String& script)
+{
+    fInjectedScripts.push_back(script);
+}
+
+void WebServer::send(const uint8_t* data, size_t size, Client client, bool binary)
+{
+    ClientContextPtr ctx = getClient(client);
+
+    if (ctx != nullptr) {
+        enqueue(client, *ctx, data, size, binary);
+    }
 }
 
 void WebServer::send(const char* data, Client client)
@@ -133,18 +278,22 @@ void WebServer::send(const char* data, Client client)
     send(reinterpret_cast<const uint8_t*>(data), std::strlen(data), client, /*binary*/false);
 }
 
-void WebServer::broadcast(const uint8_t* data, size_t size, Client exclude, bool binary)
+void WebServer::broadcast(int instance, const uint8_t* data, size_t size, Client exclude,
+                            bool binary)
 {
-    for (ClientContextMap::iterator it = fClients.begin(); it != fClients.end(); ++it) {
-        if (it->first != exclude) {
-            send(data, size, it->first, binary);
+    const ClientContextMapPtr clients = getClients();
+
+    for (ClientContextMap::const_iterator it = clients->cbegin(); it != clients->cend(); ++it) {
+        if ((it->second->instance == instance) && (it->first != exclude)) {
+            enqueue(it->first, *it->second, data, size, binary);
         }
     }
 }
 
-void WebServer::broadcast(const char* data, Client exclude)
+void WebServer::broadcast(int instance, const char* data, Client exclude)
 {
-    broadcast(reinterpret_cast<const uint8_t*>(data), std::strlen(data), exclude, /*binary*/false);
+    broadcast(instance, reinterpret_cast<const uint8_t*>(data), std::strlen(data), exclude,
+                /*binary*/false);
 }
 
 void WebServer::serve(bool block)
@@ -159,26 +308,57 @@ void WebServer::cancel()
     lws_cancel_service(fContext);
 }
 
-Client WebServer::getClientByUserAgentComponent(String& userAgentComponent)
+ClientRole WebServer::getClientRole(Client client)
 {
-    for (ClientContextMap::iterator it = fClients.begin(); it != fClients.end(); ++it) {
-        if (it->second.userAgent.contains(userAgentComponent)) {
-            return it->first;
-        }
+    ClientContextPtr ctx = getClient(client);
+
+    if (ctx == nullptr) {
+        return kClientRoleRemote;
     }
 
-    return nullptr;
+    const MutexLocker clientScopedLock(fMutex);
+
+    return ctx->role;
 }
 
-void WebServer::setClientUserAgent(Client client, String& userAgent)
+void WebServer::setClientRole(Client client, ClientRole role)
 {
-    ClientContextMap::iterator it = fClients.find(client);
+    ClientContextPtr ctx = getClient(client);
 
-    if (it != fClients.end()) {
-        it->second.userAgent = userAgent;
+    if (ctx != nullptr) {
+        const MutexLocker clientScopedLock(fMutex);
+        ctx->role = role;
     }
 }
 
+ClientInfoVector WebServer::getClientInfo(int instance)
+{
+    const ClientContextMapPtr clients = getClients();
+    ClientInfoVector info;
+    info.reserve(clients->size());
+
+    const MutexLocker statsScopedLock(fMutex);
+
+    for (ClientContextMap::const_iterator it = clients->cbegin(); it != clients->cend(); ++it) {
+        const ClientContext& ctx = *it->second;
+
+        if ((instance != 0) && (ctx.instance != instance)) {
+            continue;
+        }
+
+        ClientInfo ci;
+        ci.client = it->first;
+        ci.instance = ctx.instance;
+        ci.role = ctx.role;
+        ci.address = ctx.address;
+        ci.queueDepth = ctx.writeBuffer.size();
+        ci.stats = ctx.stats;
+        info.push_back(ci);
+    }
+
+    return info;
+}
+
 int WebServer::lwsCallback(struct lws* wsi, enum lws_callback_reasons reason,
                            void* user, void* in, size_t len)
 {
@@ -192,20 +372,17 @@ int WebServer::lwsCallback(struct lws* wsi, enum lws_callback_reasons reason,
             rc = server->injectScripts(args);
             break;
         }
-        case LWS_CALLBACK_ESTABLISHED: {
-            char userAgent[1024];
-            if (lws_hdr_copy(wsi, userAgent, sizeof(userAgent), WSI_TOKEN_HTTP_USER_AGENT) < 0) {
-                userAgent[0] = '\0';   
-            }
-            ClientContext ctx;
-            ctx.userAgent = userAgent;
-            server->fClients.emplace(wsi, ctx);
-            server->fHandler->handleWebServerConnect(wsi);
+        case LWS_CALLBACK_HTTP:
+            rc = server->handleHttpRequest(wsi);
+            break;
+        case LWS_CALLBACK_ESTABLISHED:
+            server->handleConnect(wsi);
             break;
-        }
         case LWS_CALLBACK_CLOSED:
-            server->fClients.erase(server->fClients.find(wsi));
-            server->fHandler->handleWebServerDisconnect(wsi);
+            server->handleDisconnect(wsi);
+            break;
+        case LWS_CALLBACK_RECEIVE_PONG:
+            server->handlePong(wsi, in, len);
             break;
         case LWS_CALLBACK_RECEIVE:
             rc = server->handleRead(wsi, in, len, lws_frame_is_binary(wsi));
@@ -270,35 +447,537 @@ int WebServer::injectScripts(lws_process_html_args* args)
     return rc;
 }
 
+int WebServer::handleHttpRequest(Client client)
+{
+    char uri[64];
+    if (lws_hdr_copy(client, uri, sizeof(uri), WSI_TOKEN_GET_URI) < 0) {
+        return 1;
+    }
+
+#if defined(DPF_WEBUI_NETWORK_STATS)
+    if (std::strncmp(uri, "/stats", 6) == 0) {
+        return writeStats(client);
+    }
+#endif
+
+    return writeInstanceList(client);
+}
+
+int WebServer::writeInstanceList(Client client)
+{
+    String json("[");
+
+    {
+        const MutexLocker handlerScopedLock(fHandlerMutex);
+
+        for (HandlerMap::const_iterator it = fHandlers.cbegin(); it != fHandlers.cend(); ++it) {
+            if (it != fHandlers.cbegin()) {
+                json += ",";
+            }
+
+            json += String("{\"instance\":") + String(it->first)
+                + String(",\"path\":\"/?instance=") + String(it->first) + String("\"}");
+        }
+    }
+
+    json += "]";
+
+    return writeHttpResponse(client, "application/json", json);
+}
+
+#if defined(DPF_WEBUI_NETWORK_STATS)
+int WebServer::writeStats(Client client)
+{
+    const ServerStats server = getServerStats();
+    const ClientInfoVector info = getClientInfo();
+
+    String json = String("{\"server\":{\"clients\":") + String(static_cast<unsigned long>(server.clients))
+        + String(",\"sendRate\":") + String(server.sendRate)
+        + String(",\"receiveRate\":") + String(server.receiveRate)
+        + String(",\"sendBandwidth\":") + String(server.sendBandwidth)
+        + String(",\"receiveBandwidth\":") + String(server.receiveBandwidth)
+        + String(",\"messagesDropped\":") + String(static_cast<unsigned long long>(server.messagesDropped))
+        + String(",\"rttMedian\":") + String(server.rttMedian)
+        + String(",\"rtt99\":") + String(server.rtt99)
+        + String(",\"cpuLoad\":") + String(server.cpuLoad)
+        + String(",\"peakResidentSize\":") + String(static_cast<long long>(server.peakResidentSize))
+        + String("},\"clients\":[");
+
+    for (ClientInfoVector::const_iterator it = info.cbegin(); it != info.cend(); ++it) {
+        if (it != info.cbegin()) {
+            json += ",";
+        }
+
+        const ClientStats& st = it->stats;
+
+        json += String("{\"instance\":") + String(it->instance)
+            + String(",\"role\":\"") + getClientRoleName(it->role)
+            + String("\",\"address\":\"") + it->address
+            + String("\",\"queueDepth\":") + String(static_cast<unsigned long>(it->queueDepth))
+            + String(",\"bytesSent\":") + String(static_cast<unsigned long long>(st.bytesSent))
+            + String(",\"bytesReceived\":") + String(static_cast<unsigned long long>(st.bytesReceived))
+            + String(",\"messagesSent\":") + String(static_cast<unsigned long long>(st.messagesSent))
+            + String(",\"messagesReceived\":") + String(static_cast<unsigned long long>(st.messagesReceived))
+            + String(",\"messagesDropped\":") + String(static_cast<unsigned long long>(st.messagesDropped))
+            + String(",\"sendRate\":") + String(st.sendRate)
+            + String(",\"receiveRate\":") + String(st.receiveRate)
+            + String(",\"rtt\":") + String(st.rtt)
+            + String(",\"pingTimeouts\":") + String(static_cast<unsigned long long>(st.pingTimeouts))
+            + String("}");
+    }
+
+    json += "]}";
+
+    return writeHttpResponse(client, "application/json", json);
+}
+#endif // DPF_WEBUI_NETWORK_STATS
+
+int WebServer::writeHttpResponse(Client client, const char* contentType, const String& body)
+{
+    const size_t size = body.length();
+    ByteVector buf(LWS_PRE + 512 + size);
+    uint8_t* start = buf.data() + LWS_PRE;
+    uint8_t* end = buf.data() + buf.size();
+    uint8_t* p = start;
+
+    if (lws_add_http_common_headers(client, HTTP_STATUS_OK, contentType, size, &p, end)
+            || lws_finalize_write_http_header(client, start, &p, end)) {
+        return 1;
+    }
+
+    std::memcpy(start, body.buffer(), size);
+
+    if (lws_write(client, start, size, LWS_WRITE_HTTP_FINAL) != static_cast<int>(size)) {
+        return 1;
+    }
+
+    return lws_http_transaction_completed(client) ? -1 : 0;
+}
+
+int WebServer::resolveInstance(Client client)
+{
+    const MutexLocker handlerScopedLock(fHandlerMutex);
+
+    if (fHandlers.empty()) {
+        return 0;
+    }
+
+    char arg[16];
+    const char* value = lws_get_urlarg_by_name(client, "instance=", arg, sizeof(arg));
+
+    if (value == nullptr) {
+        return fHandlers.cbegin()->first;
+    }
+
+    const int instance = std::atoi(value);
+
+    return fHandlers.find(instance) != fHandlers.cend() ? instance : 0;
+}
+
+ClientRole WebServer::classifyClient(Client client, const char* address)
+{
+    // Done once per connection so message routing never needs to look at
+    // request headers or addresses again.
+    char userAgent[1024];
+    if (lws_hdr_copy(client, userAgent, sizeof(userAgent), WSI_TOKEN_HTTP_USER_AGENT) < 0) {
+        userAgent[0] = '\0';
+    }
+
+    if (! fWebViewUserAgent.isEmpty() && (std::strstr(userAgent, fWebViewUserAgent) != nullptr)) {
+        return kClientRoleWebView;
+    }
+
+#if defined(DPF_WEBUI_NETWORK_UNIX_SOCKET)
+    if ((fUnixVhost != nullptr) && (lws_get_vhost(client) == fUnixVhost)) {
+        return kClientRoleLocal;
+    }
+#endif
+
+    if ((std::strcmp(address, "127.0.0.1") == 0) || (std::strcmp(address, "::1") == 0)
+            || (std::strcmp(address, "::ffff:127.0.0.1") == 0)) {
+        return kClientRoleLocal;
+    }
+
+    return kClientRoleRemote;
+}
+
+void WebServer::handleConnect(Client client)
+{
+    char address[64];
+    if (lws_get_peer_simple(client, address, sizeof(address)) == nullptr) {
+        address[0] = '\0';
+    }
+
+    const int instance = resolveInstance(client);
+    const ClientRole role = classifyClient(client, address);
+    ClientContextPtr ctx = std::make_shared<ClientContext>(instance, role, address);
+
+    addClient(client, ctx);
+
+    const MutexLocker handlerScopedLock(fHandlerMutex);
+
+    HandlerMap::const_iterator it = fHandlers.find(instance);
+    if (it != fHandlers.cend()) {
+        it->second->handleWebServerConnect(client, role);
+    } else {
+        // No such instance, close on first writable callback
+        const MutexLocker writeBufferScopedLock(fMutex);
+        ctx->closed = true;
+        lws_callback_on_writable(client);
+    }
+}
+
+void WebServer::handleDisconnect(Client client)
+{
+    ClientContextPtr ctx = getClient(client);
+    if (ctx == nullptr) {
+        return;
+    }
+
+    removeClient(client);
+
+    const MutexLocker handlerScopedLock(fHandlerMutex);
+
+    HandlerMap::const_iterator it = fHandlers.find(ctx->instance);
+    if (it != fHandlers.cend()) {
+        it->second->handleWebServerDisconnect(client);
+    }
+}
+
+void WebServer::handlePong(Client client, const void* data, size_t size)
+{
+    ClientContextPtr ctx = getClient(client);
+    if ((ctx == nullptr) || (ctx->pingTime == 0)) {
+        return;
+    }
+
+    // Late answers to pings that already timed out are ignored
+    uint32_t sequence = 0;
+    if (size == sizeof(sequence)) {
+        std::memcpy(&sequence, data, size);
+    }
+
+    if ((size != sizeof(sequence)) || (sequence != ctx->pingSequence)) {
+        return;
+    }
+
+    const double sample = static_cast<double>(getTimeUs() - ctx->pingTime) / 1000.0;
+    ctx->pingTime = 0;
+
+    const MutexLocker statsScopedLock(fMutex);
+    addRttSample(ctx->stats, sample);
+}
+
+// Called with fMutex held
+void WebServer::addRttSample(ClientStats& stats, double sample)
+{
+    double& rtt = stats.rtt;
+    rtt = rtt < 0 ? sample : rtt + RTT_SMOOTHING * (sample - rtt);
+}
+
+void WebServer::updateStats()
+{
+    const ClientContextMapPtr clients = getClients();
+    const double interval = static_cast<double>(STATS_INTERVAL_US) / 1000000.0;
+    const int64_t now = getTimeUs();
+
+    const MutexLocker statsScopedLock(fMutex);
+
+    for (ClientContextMap::const_iterator it = clients->cbegin(); it != clients->cend(); ++it) {
+        ClientContext& ctx = *it->second;
+        ClientStats& st = ctx.stats;
+
+        st.sendRate = static_cast<double>(st.messagesSent - ctx.lastMessagesSent) / interval;
+        st.receiveRate = static_cast<double>(st.messagesReceived - ctx.lastMessagesReceived) / interval;
+        ctx.lastMessagesSent = st.messagesSent;
+        ctx.lastMessagesReceived = st.messagesReceived;
+
+        // Browsers answer WebSocket pings automatically. A ping that stays
+        // unanswered past the deadline counts as a timeout and as an RTT
+        // sample of the time waited, then the client is probed again.
+        if ((ctx.pingTime != 0) && ((now - ctx.pingTime) > PING_TIMEOUT_US)) {
+            st.pingTimeouts++;
+            addRttSample(st, static_cast<double>(now - ctx.pingTime) / 1000.0);
+            ctx.pingTime = 0;
+        }
+
+        if (! ctx.closed && (ctx.pingTime == 0)) {
+            ctx.pingPending = true;
+            lws_callback_on_writable(it->first);
+        }
+    }
+
+#if defined(DPF_WEBUI_NETWORK_STATS)
+    updateServerStats(*clients, interval);
+#endif
+}
+
+#if defined(DPF_WEBUI_NETWORK_STATS)
+// Called with fMutex held
+void WebServer::updateServerStats(const ClientContextMap& clients, double interval)
+{
+    ServerStats stats;
+    std::vector<double> rtt;
+
+    for (ClientContextMap::const_iterator it = clients.cbegin(); it != clients.cend(); ++it) {
+        ClientContext& ctx = *it->second;
+        const ClientStats& st = ctx.stats;
+
+        stats.clients++;
+        stats.sendRate += st.sendRate;
+        stats.receiveRate += st.receiveRate;
+        stats.sendBandwidth += static_cast<double>(st.bytesSent - ctx.lastBytesSent) / interval;
+        stats.receiveBandwidth += static_cast<double>(st.bytesReceived - ctx.lastBytesReceived)
+                                    / interval;
+        stats.messagesDropped += st.messagesDropped;
+        ctx.lastBytesSent = st.bytesSent;
+        ctx.lastBytesReceived = st.bytesReceived;
+
+        if (st.rtt >= 0) {
+            rtt.push_back(st.rtt);
+        }
+    }
+
+    if (! rtt.empty()) {
+        std::sort(rtt.begin(), rtt.end());
+        stats.rttMedian = rtt[(rtt.size() - 1) / 2];
+        stats.rtt99 = rtt[(rtt.size() * 99 + 99) / 100 - 1];
+    }
+
+    const int64_t cpuTime = getProcessCpuTimeUs();
+    if ((cpuTime >= 0) && (fLastCpuTime >= 0)) {
+        stats.cpuLoad = 100.0 * static_cast<double>(cpuTime - fLastCpuTime)
+                            / static_cast<double>(STATS_INTERVAL_US);
+    }
+    fLastCpuTime = cpuTime;
+
+    stats.peakResidentSize = getProcessPeakResidentSize();
+    fServerStats = stats;
+}
+
+ServerStats WebServer::getServerStats()
+{
+    const MutexLocker statsScopedLock(fMutex);
+    return fServerStats;
+}
+
+// User plus system time for the whole process, -1 if unknown
+int64_t WebServer::getProcessCpuTimeUs()
+{
+#if defined(DISTRHO_OS_WINDOWS)
+    FILETIME creation, exit, kernel, user;
+    if (! GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return -1;
+    }
+
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+
+    return static_cast<int64_t>((k.QuadPart + u.QuadPart) / 10); // 100 ns units
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+
+    return (static_cast<int64_t>(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+int64_t WebServer::getProcessPeakResidentSize()
+{
+#if defined(DISTRHO_OS_WINDOWS)
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+# if defined(DISTRHO_OS_MAC)
+    return static_cast<int64_t>(usage.ru_maxrss);        // bytes
+# else
+    return static_cast<int64_t>(usage.ru_maxrss) * 1024; // KiB
+# endif
+#endif
+}
+#endif // DPF_WEBUI_NETWORK_STATS
+
+void WebServer::statsTimerCallback(lws_sorted_usec_list_t* sul)
+{
+    WebServer* server = reinterpret_cast<StatsTimer*>(sul)->server;
+    server->updateStats();
+    lws_sul_schedule(server->fContext, 0, &server->fStatsTimer.sul, WebServer::statsTimerCallback,
+                        STATS_INTERVAL_US);
+}
+
+int64_t WebServer::getTimeUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 int WebServer::handleRead(Client client, void* in, size_t len, bool binary)
 {
     int rc = 0;
 
-    ByteVector& rb = fClients[client].readBuffer;
-    rb.insert(rb.end(), static_cast<uint8_t*>(in), static_cast<uint8_t*>(in) + len);
+    ClientContextPtr ctx = getClient(client);
+    if (ctx == nullptr) {
+        return rc;
+    }
+
+    const MutexLocker handlerScopedLock(fHandlerMutex);
 
-    if (lws_remaining_packet_payload(client) != 0) {
+    HandlerMap::const_iterator hit = fHandlers.find(ctx->instance);
+    if (hit == fHandlers.cend()) {
         return rc;
     }
 
+    WebServerHandler* handler = hit->second;
+    const uint8_t* data = static_cast<const uint8_t*>(in);
+    ByteVector& rb = ctx->readBuffer;
+
+    // A message can span multiple frames and each frame can be delivered in
+    // multiple chunks, it is complete after the last chunk of the final frame.
+    const bool last = lws_is_final_fragment(client) && (lws_remaining_packet_payload(client) == 0);
+
+    {
+        const MutexLocker statsScopedLock(fMutex);
+        ctx->stats.bytesReceived += len;
+        if (last) {
+            ctx->stats.messagesReceived++;
+        }
+    }
+
+    // Buffer the start of binary messages until it can be offered for streaming
+    if (binary && ! ctx->streamOffered) {
+        if (! last && (rb.size() + len < kStreamProbeSize)) {
+            rb.insert(rb.end(), data, data + len);
+            return rc;
+        }
+
+        ctx->streamOffered = true;
+
+        if (! rb.empty()) {
+            rb.insert(rb.end(), data, data + len);
+            data = rb.data();
+            len = rb.size();
+        }
+
+        ctx->streaming = handler->handleWebServerStreamBegin(client, data, len);
+
+        if (! ctx->streaming && ! rb.empty()) {
+            if (! last) {
+                reserveReadBuffer(client, rb, rb.data(), rb.size(), binary);
+            }
+
+            len = 0; // already buffered
+        }
+    }
+
+    if (ctx->streaming) {
+        rc = handler->handleWebServerStream(client, data, len, last);
+        rb.clear();
+
+        if (last) {
+            ctx->streaming = false;
+            ctx->streamOffered = false;
+        }
+
+        return rc;
+    }
+
+    if (rb.empty() && ! last) {
+        reserveReadBuffer(client, rb, data, len, binary);
+    }
+
+    rb.insert(rb.end(), data, data + len);
+
+    if (! last) {
+        return rc;
+    }
+
+    ctx->streamOffered = false;
+
     if (binary) {
-        rc = fHandler->handleWebServerRead(client, rb);
+        rc = handler->handleWebServerRead(client, rb);
     } else {
         rb.push_back('\0');
-        rc = fHandler->handleWebServerRead(client, reinterpret_cast<const char*>(rb.data()));
+        rc = handler->handleWebServerRead(client, reinterpret_cast<const char*>(rb.data()));
     }
 
     rb.clear();
 
+    // Do not let a single large message pin memory for the client lifetime
+    if (rb.capacity() > READ_BUFFER_RETAIN_SIZE) {
+        ByteVector().swap(rb);
+    }
+
     return rc;
 }
 
+void WebServer::reserveReadBuffer(Client client, ByteVector& rb, const uint8_t* data, size_t len,
+                                    bool binary)
+{
+    // Size the buffer once for the whole message so appending chunks does not
+    // trigger repeated reallocations and copies. BSON documents start with
+    // their total size, otherwise the remaining payload of the current frame
+    // is the best available estimate.
+    size_t size = len + lws_remaining_packet_payload(client);
+
+    if (binary && (len >= 4)) {
+        const int32_t bsonSize = static_cast<int32_t>(data[0] | (data[1] << 8)
+                                    | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24));
+        if ((bsonSize > 0) && (static_cast<size_t>(bsonSize) > size)) {
+            size = static_cast<size_t>(bsonSize);
+        }
+    }
+
+    if (size > READ_BUFFER_RESERVE_LIMIT) {
+        size = READ_BUFFER_RESERVE_LIMIT;
+    }
+
+    rb.reserve(binary ? size : size + 1 /* null terminator */);
+}
+
 int WebServer::handleWrite(Client client)
 {
+    ClientContextPtr ctx = getClient(client);
+    if (ctx == nullptr) {
+        return 0;
+    }
+
     const MutexLocker writeBufferScopedLock(fMutex);
 
+    if (ctx->closed) {
+        return -1; // instance removed
+    }
+
     // Exactly one lws_write() call per LWS_CALLBACK_SERVER_WRITEABLE callback
-    ClientContext::ByteVectorList& wb = fClients[client].writeBuffer;
+    ClientContext::ByteVectorList& wb = ctx->writeBuffer;
+
+    if (ctx->pingPending) {
+        ctx->pingPending = false;
+        ctx->pingTime = getTimeUs();
+        ctx->pingSequence++;
+
+        uint8_t ping[LWS_PRE + sizeof(ctx->pingSequence)];
+        std::memcpy(ping + LWS_PRE, &ctx->pingSequence, sizeof(ctx->pingSequence));
+
+        if (lws_write(client, ping + LWS_PRE, sizeof(ctx->pingSequence), LWS_WRITE_PING) < 0) {
+            return -1;
+        }
+
+        if (! wb.empty()) {
+            lws_callback_on_writable(client);
+        }
+
+        return 0;
+    }
+
     if (wb.empty()) {
         return 0;
     }
@@ -313,5 +992,72 @@ int WebServer::handleWrite(Client client)
         lws_callback_on_writable(client);
     }
 
-    return writeSize == dataSize ? 0 : -1;
+    if (writeSize != dataSize) {
+        ctx->stats.messagesDropped++;
+        return -1;
+    }
+
+    ctx->stats.bytesSent += dataSize;
+    ctx->stats.messagesSent++;
+
+    return 0;
+}
+
+WebServer::ClientContextMapPtr WebServer::getClients() const
+{
+    return std::atomic_load(&fClients);
+}
+
+WebServer::ClientContextPtr WebServer::getClient(Client client) const
+{
+    const ClientContextMapPtr clients = getClients();
+    ClientContextMap::const_iterator it = clients->find(client);
+
+    return it != clients->cend() ? it->second : nullptr;
+}
+
+void WebServer::addClient(Client client, const ClientContextPtr& ctx)
+{
+    // Only the lws thread modifies the registry, no need to serialize writers
+    std::shared_ptr<ClientContextMap> clients = std::make_shared<ClientContextMap>(*getClients());
+    clients->emplace(client, ctx);
+    std::atomic_store(&fClients, ClientContextMapPtr(clients));
+}
+
+void WebServer::removeClient(Client client)
+{
+    ClientContextPtr ctx = getClient(client);
+    if (ctx == nullptr) {
+        return;
+    }
+
+    // Other threads might still hold the context through an older snapshot,
+    // mark it closed so they stop scheduling writes on a soon invalid handle.
+    {
+        const MutexLocker writeBufferScopedLock(fMutex);
+        ctx->closed = true;
+        ctx->writeBuffer.clear();
+    }
+
+    std::shared_ptr<ClientContextMap> clients = std::make_shared<ClientContextMap>(*getClients());
+    clients->erase(client);
+    std::atomic_store(&fClients, ClientContextMapPtr(clients));
+}
+
+void WebServer::enqueue(Client client, ClientContext& ctx, const uint8_t* data, size_t size,
+                        bool binary)
+{
+    ClientContext::FrameData frame(binary);
+    frame.data.insert(frame.data.end(), data, data + size);
+
+    const MutexLocker writeBufferScopedLock(fMutex);
+
+    if (ctx.closed) {
+        ctx.stats.messagesDropped++;
+        return;
+    }
+
+    ctx.writeBuffer.push_back(std::move(frame));
+
+    lws_callback_on_writable(client);
 }
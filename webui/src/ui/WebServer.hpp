@@ -18,6 +18,8 @@
 #define WEB_SERVER_HPP
 
 #include <list>
+#include <map>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
@@ -33,6 +35,97 @@ START_NAMESPACE_DISTRHO
 typedef struct lws* Client;
 typedef std::vector<uint8_t> ByteVector;
 
+static const size_t kStreamProbeSize = 16; // see WebServerHandler
+
+enum ClientRole
+{
+    kClientRoleRemote,  // device in the local network
+    kClientRoleLocal,   // web browser or tool running on the same machine
+    kClientRoleWebView  // plugin embedded web view
+};
+
+// Name used in stats reports
+inline const char* getClientRoleName(ClientRole role)
+{
+    switch (role) {
+        case kClientRoleRemote:
+            return "remote";
+        case kClientRoleLocal:
+            return "local";
+        case kClientRoleWebView:
+            return "webview";
+    }
+
+    return "unknown";
+}
+
+struct ClientStats
+{
+    ClientStats()
+        : bytesSent(0)
+        , bytesReceived(0)
+        , messagesSent(0)
+        , messagesReceived(0)
+        , messagesDropped(0)
+        , sendRate(0)
+        , receiveRate(0)
+        , rtt(-1)
+        , pingTimeouts(0)
+    {}
+
+    uint64_t bytesSent;
+    uint64_t bytesReceived;
+    uint64_t messagesSent;
+    uint64_t messagesReceived;
+    uint64_t messagesDropped; // not delivered because of closing or write errors
+    double   sendRate;        // messages per second over the last stats interval
+    double   receiveRate;
+    double   rtt;             // smoothed WebSocket ping round trip in ms, -1 if unknown
+    uint64_t pingTimeouts;    // pings left unanswered, each counts as an RTT sample
+};
+
+struct ClientInfo
+{
+    Client      client;
+    int         instance;
+    ClientRole  role;
+    String      address;
+    size_t      queueDepth;   // frames waiting to be written
+    ClientStats stats;
+};
+
+typedef std::vector<ClientInfo> ClientInfoVector;
+
+#if defined(DPF_WEBUI_NETWORK_STATS)
+// Aggregate over all clients, meant for observing the server under load
+struct ServerStats
+{
+    ServerStats()
+        : clients(0)
+        , sendRate(0)
+        , receiveRate(0)
+        , sendBandwidth(0)
+        , receiveBandwidth(0)
+        , messagesDropped(0)
+        , rttMedian(-1)
+        , rtt99(-1)
+        , cpuLoad(-1)
+        , peakResidentSize(-1)
+    {}
+
+    size_t   clients;
+    double   sendRate;         // messages per second over the last stats interval
+    double   receiveRate;
+    double   sendBandwidth;    // bytes per second over the last stats interval
+    double   receiveBandwidth;
+    uint64_t messagesDropped;
+    double   rttMedian;        // ms across clients with a known RTT, -1 if none
+    double   rtt99;
+    double   cpuLoad;          // process CPU time over wall time in %, -1 if unknown
+    int64_t  peakResidentSize; // process peak RSS in bytes, -1 if unknown
+};
+#endif
+
 struct ClientContext
 {
     struct FrameData
@@ -48,65 +141,189 @@ struct ClientContext
 
     typedef std::list<FrameData> ByteVectorList;
 
-    String         userAgent;
-    ByteVector     readBuffer;
-    ByteVectorList writeBuffer;
+    ClientContext(int instance, ClientRole role, const char* address)
+        : instance(instance)
+        , address(address)
+        , role(role)
+        , streaming(false)
+        , streamOffered(false)
+        , pingTime(0)
+        , pingSequence(0)
+        , lastMessagesSent(0)
+        , lastMessagesReceived(0)
+        , lastBytesSent(0)
+        , lastBytesReceived(0)
+        , closed(false)
+        , pingPending(false)
+    {}
+
+    const int      instance;    // plugin instance the client is bound to
+    const String   address;     // peer address
+    ClientRole     role;        // guarded by WebServer::fMutex
+    ByteVector     readBuffer;  // only accessed from the lws thread
+    bool           streaming;   // only accessed from the lws thread
+    bool           streamOffered; // only accessed from the lws thread, reset after every message
+    int64_t        pingTime;    // only accessed from the lws thread, 0 if no ping in flight
+    uint32_t       pingSequence; // only accessed from the lws thread, payload of the last ping
+    uint64_t       lastMessagesSent;     // only accessed from the lws thread
+    uint64_t       lastMessagesReceived; // only accessed from the lws thread
+    uint64_t       lastBytesSent;        // only accessed from the lws thread
+    uint64_t       lastBytesReceived;    // only accessed from the lws thread
+    ByteVectorList writeBuffer; // guarded by WebServer::fMutex
+    ClientStats    stats;       // guarded by WebServer::fMutex
+    bool           closed;      // guarded by WebServer::fMutex
+    bool           pingPending; // guarded by WebServer::fMutex
 };
 
 struct WebServerHandler
 {
-    virtual void handleWebServerConnect(Client) {};
+    virtual void handleWebServerConnect(Client, ClientRole) {};
     virtual void handleWebServerDisconnect(Client) {};
     virtual int  handleWebServerRead(Client client, const ByteVector& data) = 0;
     virtual int  handleWebServerRead(Client client, const char* data) = 0;
+
+    // Binary messages can be consumed as they arrive instead of being buffered
+    // whole. Every binary message is offered to handleWebServerStreamBegin()
+    // with its first kStreamProbeSize bytes at least, or all of them if it is
+    // shorter, regardless of how the client split it into frames. Returning
+    // true claims the message and makes the server pass all its bytes, those
+    // offered included, to handleWebServerStream(). Both are called from the
+    // lws thread.
+    virtual bool handleWebServerStreamBegin(Client, const uint8_t*, size_t) { return false; };
+    virtual int  handleWebServerStream(Client, const uint8_t*, size_t, bool) { return 0; };
 };
 
+// A single server can be shared by multiple plugin instances. Each instance
+// registers a handler and gets an ID that clients pass in the URL query string
+// (/?instance=N), clients that omit it are bound to the oldest instance.
+// Handlers are never called after removeHandler() returns.
+
 class WebServer
 {
 public:
     WebServer();
     virtual ~WebServer();
 
-    void init(int port, WebServerHandler* handler, const char* jsInjectTarget = nullptr,
-                const char* jsInjectToken = nullptr);
+    int  init(int port, const char* webViewUserAgent = nullptr,
+                const char* jsInjectTarget = nullptr, const char* jsInjectToken = nullptr);
+    int  getPort() const noexcept { return fPort; }
+    int  addHandler(WebServerHandler* handler);
+    void removeHandler(int instance);
     void injectScript(const String& script);
     void send(const uint8_t* data, size_t size, Client client, bool binary = true);
     void send(const char* data, Client client);
-    void broadcast(const uint8_t* data, size_t size, Client exclude = nullptr, bool binary = true);
-    void broadcast(const char* data, Client exclude = nullptr);
+    void broadcast(int instance, const uint8_t* data, size_t size, Client exclude = nullptr,
+                    bool binary = true);
+    void broadcast(int instance, const char* data, Client exclude = nullptr);
     void serve(bool block = true);
     void cancel();
 
-    Client getClientByUserAgentComponent(String& userAgentComponent);
-    void   setClientUserAgent(Client client, String& userAgent);
+    ClientRole getClientRole(Client client);
+    void       setClientRole(Client client, ClientRole role);
+
+    // Pass instance 0 for clients of all instances
+    ClientInfoVector getClientInfo(int instance = 0);
+
+#if defined(DPF_WEBUI_NETWORK_STATS)
+    // Updated every stats interval, also served at /stats
+    ServerStats getServerStats();
+#endif
+
+#if defined(DPF_WEBUI_NETWORK_UNIX_SOCKET)
+    // Path of the additional Unix domain socket listener, empty if it could
+    // not be created. On Linux the socket lives in the abstract namespace and
+    // the path starts with '@', which stands for the leading null byte.
+    const String& getUnixSocketPath() const noexcept { return fUnixSocketPath; }
+#endif
 
 private:
+    typedef std::shared_ptr<ClientContext> ClientContextPtr;
+    typedef std::unordered_map<Client, ClientContextPtr> ClientContextMap;
+    typedef std::shared_ptr<const ClientContextMap> ClientContextMapPtr;
+
+    struct StatsTimer
+    {
+        lws_sorted_usec_list_t sul; // must be first
+        WebServer*             server;
+    };
+
     static int lwsCallback(struct lws* wsi, enum lws_callback_reasons reason,
                            void* user, void* in, size_t len);
     static const char* lwsReplaceFunc(void* data, int index);
 
+#if defined(DPF_WEBUI_NETWORK_UNIX_SOCKET)
+    void createUnixSocketVhost(int port);
+#endif
     int injectScripts(lws_process_html_args* args);
+    int handleHttpRequest(Client client);
+    int writeInstanceList(Client client);
+#if defined(DPF_WEBUI_NETWORK_STATS)
+    int writeStats(Client client);
+#endif
+    int writeHttpResponse(Client client, const char* contentType, const String& body);
+    int resolveInstance(Client client);
+    ClientRole classifyClient(Client client, const char* address);
+    void handleConnect(Client client);
+    void handleDisconnect(Client client);
+    void handlePong(Client client, const void* data, size_t size);
+    void updateStats();
+    static void addRttSample(ClientStats& stats, double sample);
+#if defined(DPF_WEBUI_NETWORK_STATS)
+    void updateServerStats(const ClientContextMap& clients, double interval);
+    static int64_t getProcessCpuTimeUs();
+    static int64_t getProcessPeakResidentSize();
+#endif
+    static void statsTimerCallback(lws_sorted_usec_list_t* sul);
+    static int64_t getTimeUs();
     int handleRead(Client client, void* in, size_t len, bool binary);
+    void reserveReadBuffer(Client client, ByteVector& rb, const uint8_t* data, size_t len,
+                            bool binary);
     int handleWrite(Client client);
 
+    ClientContextMapPtr getClients() const;
+    ClientContextPtr    getClient(Client client) const;
+    void addClient(Client client, const ClientContextPtr& ctx);
+    void removeClient(Client client);
+    void enqueue(Client client, ClientContext& ctx, const uint8_t* data, size_t size, bool binary);
+
     char                       fMountOrigin[PATH_MAX];
     lws_http_mount             fMount;
+    lws_http_mount             fInstancesMount;
+#if defined(DPF_WEBUI_NETWORK_STATS)
+    lws_http_mount             fStatsMount;
+    ServerStats                fServerStats; // guarded by fMutex
+    int64_t                    fLastCpuTime; // only accessed from the lws thread
+#endif
     lws_protocol_vhost_options fMountOptions;
     lws_protocols              fProtocols[2];
     lws_extension              fExtensions[2];
     lws_context_creation_info  fContextInfo;
     lws_context*               fContext;
+    lws_vhost*                 fVhost;
+    int                        fPort;
+    StatsTimer                 fStatsTimer;
+#if defined(DPF_WEBUI_NETWORK_UNIX_SOCKET)
+    lws_vhost*                 fUnixVhost;
+    String                     fUnixSocketPath;
+#endif
 
     Mutex fMutex;
 
-    typedef std::unordered_map<Client, ClientContext> ClientContextMap;
-    ClientContextMap fClients;
+    // Copy-on-write registry. The lws thread replaces the map on connection
+    // setup and teardown, readers iterate an immutable snapshot without locks.
+    ClientContextMapPtr fClients;
 
     typedef std::list<String> StringList;
     StringList fInjectedScripts;
     String     fInjectToken;
+    String     fWebViewUserAgent;
 
-    WebServerHandler *fHandler;
+    // Handlers are called while holding this lock so they can be removed
+    // from any thread without racing the lws thread.
+    typedef std::map<int, WebServerHandler*> HandlerMap;
+    Mutex      fHandlerMutex;
+    HandlerMap fHandlers;
+    int        fLastInstance;
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WebServer)
 
@@ -14,12 +14,20 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#if defined(DPF_WEBUI_MESSAGE_STATS) || defined(DPF_WEBUI_ALLOC_STATS)
+# include <chrono>
+# include <cstring>
+#endif
+
 #include "WebUIBase.hpp"
 #include "DistrhoPluginInfo.h"
 
 #include "distrho/DistrhoPluginUtils.hpp"
 #include "distrho/extra/Base64.hpp"
 
+#define MESSAGE_STATS_INTERVAL_US 5000000
+#define ALLOC_STATS_INTERVAL_US   5000000
+
 USE_NAMESPACE_DISTRHO
 
 WebUIBase::WebUIBase(uint widthCssPx, uint heightCssPx, float initPixelRatio,
@@ -30,19 +38,49 @@ WebUIBase::WebUIBase(uint widthCssPx, uint heightCssPx, float initPixelRatio,
     , fFuncArgSerializer(funcArgSerializer != nullptr ? funcArgSerializer
                             : [](const char* f) { return f; })
 {
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+    std::memset(fStageStats, 0, sizeof(fStageStats));
+    fStatsTime = getTimeUs();
+#endif
+#if defined(DPF_WEBUI_ALLOC_STATS)
+    fAllocStatsTime = getTimeUs();
+#endif
     setBuiltInFunctionHandlers();
 }
 
 void WebUIBase::callback(const char* function, Variant args, uintptr_t destination, uintptr_t exclude)
 {
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+    const int64_t startUs = getTimeUs();
+#endif
+#if defined(DPF_WEBUI_ALLOC_STATS)
+    const AllocScope allocScope;
+#endif
     args.insertArrayItem(0, serializeFunctionArgument(function));
     postMessage(args, destination, exclude);
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+    recordMessageStage(kMessageStageCallback, startUs);
+#endif
+#if defined(DPF_WEBUI_ALLOC_STATS)
+    const AllocCounter allocs = allocScope.get();
+    recordAllocStats("callback", function, allocs);
+#endif
 }
 
 void WebUIBase::queue(const UiBlock& block)
 {
     fUiQueueMutex.lock();
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+    const int64_t queueUs = getTimeUs();
+    fUiQueue.push([this, block, queueUs] {
+        const int64_t startUs = getTimeUs();
+        recordMessageStage(kMessageStageQueueWait, queueUs);
+        block();
+        recordMessageStage(kMessageStageQueueRun, startUs);
+    });
+#else
     fUiQueue.push(block);
+#endif
     fUiQueueMutex.unlock();
 }
 
@@ -54,6 +92,9 @@ const WebUIBase::FunctionHandler& WebUIBase::getFunctionHandler(const char* name
 void WebUIBase::setFunctionHandler(const char* name, int argCount, const FunctionHandler& handler)
 {
     fHandler[serializeFunctionArgument(name).asString()] = std::make_pair(argCount, handler);
+#if defined(DPF_WEBUI_ALLOC_STATS)
+    fHandlerNames[serializeFunctionArgument(name).asString()] = name;
+#endif
 }
 
 bool WebUIBase::isDryRun()
@@ -75,6 +116,13 @@ void WebUIBase::uiIdle()
     }
 
     fUiQueueMutex.unlock();
+
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+    printMessageStats();
+#endif
+#if defined(DPF_WEBUI_ALLOC_STATS)
+    printAllocStats();
+#endif
 }
 
 void WebUIBase::parameterChanged(uint32_t index, float value)
@@ -116,6 +164,12 @@ void WebUIBase::onMessageReceived(const Variant& payload, uintptr_t origin)
 
 void WebUIBase::handleMessage(const Variant& payload, uintptr_t origin)
 {
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+    const int64_t startUs = getTimeUs();
+#endif
+#if defined(DPF_WEBUI_ALLOC_STATS)
+    const AllocScope allocScope;
+#endif
     if (! payload.isArray() || (payload.getArraySize() == 0)) {
         d_stderr2("Message must be a non-empty array");
         return;
@@ -139,6 +193,13 @@ void WebUIBase::handleMessage(const Variant& payload, uintptr_t origin)
     }
 
     handler.second(handlerArgs, origin);
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+    recordMessageStage(kMessageStageHandle, startUs);
+#endif
+#if defined(DPF_WEBUI_ALLOC_STATS)
+    const AllocCounter allocs = allocScope.get();
+    recordAllocStats("handler", fHandlerNames[function].buffer(), allocs);
+#endif
 }
 
 Variant WebUIBase::serializeFunctionArgument(const char* function)
@@ -146,6 +207,92 @@ Variant WebUIBase::serializeFunctionArgument(const char* function)
     return fFuncArgSerializer(function);
 }
 
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+void WebUIBase::recordMessageStage(MessageStage stage, int64_t startUs)
+{
+    const int64_t elapsedUs = getTimeUs() - startUs;
+    const MutexLocker statsScopedLock(fStatsMutex);
+    MessageStageStats& st = fStageStats[stage];
+
+    st.count++;
+    st.totalUs += elapsedUs;
+    st.maxUs = elapsedUs > st.maxUs ? elapsedUs : st.maxUs;
+}
+
+void WebUIBase::printMessageStats()
+{
+    static const char* const kStageNames[] = { "handle", "queue wait", "queue run", "callback" };
+
+    const int64_t now = getTimeUs();
+    const MutexLocker statsScopedLock(fStatsMutex);
+
+    if ((now - fStatsTime) < MESSAGE_STATS_INTERVAL_US) {
+        return;
+    }
+
+    const double seconds = static_cast<double>(now - fStatsTime) / 1000000.0;
+    fStatsTime = now;
+
+    for (int i = 0; i < kMessageStageCount; ++i) {
+        const MessageStageStats& st = fStageStats[i];
+
+        if (st.count > 0) {
+            d_stderr("WebUIBase : %-10s %7.1f msg/s, mean %6.1f us, max %6lld us", kStageNames[i],
+                        static_cast<double>(st.count) / seconds,
+                        static_cast<double>(st.totalUs) / static_cast<double>(st.count),
+                        static_cast<long long>(st.maxUs));
+        }
+    }
+
+    std::memset(fStageStats, 0, sizeof(fStageStats));
+}
+
+#endif
+
+#if defined(DPF_WEBUI_ALLOC_STATS)
+void WebUIBase::recordAllocStats(const char* kind, const char* name, const AllocCounter& allocs)
+{
+    const AllocPause allocPause; // building the label and map nodes allocates
+    const MutexLocker statsScopedLock(fAllocStatsMutex);
+    AllocStatsEntry& entry = fAllocStats[std::string(kind) + " " + name];
+
+    entry.calls++;
+    entry.count += allocs.count;
+    entry.bytes += allocs.bytes;
+}
+
+void WebUIBase::printAllocStats()
+{
+    const int64_t now = getTimeUs();
+    const MutexLocker statsScopedLock(fAllocStatsMutex);
+
+    if ((now - fAllocStatsTime) < ALLOC_STATS_INTERVAL_US) {
+        return;
+    }
+
+    fAllocStatsTime = now;
+
+    for (AllocStatsMap::const_iterator it = fAllocStats.cbegin(); it != fAllocStats.cend(); ++it) {
+        const AllocStatsEntry& entry = it->second;
+        const double calls = static_cast<double>(entry.calls);
+
+        d_stderr("WebUIBase : %-32s %6llu calls, %6.1f allocs %8.1f bytes per call",
+                    it->first.c_str(), static_cast<unsigned long long>(entry.calls),
+                    static_cast<double>(entry.count) / calls, static_cast<double>(entry.bytes) / calls);
+    }
+
+    fAllocStats.clear();
+}
+#endif
+
+#if defined(DPF_WEBUI_MESSAGE_STATS) || defined(DPF_WEBUI_ALLOC_STATS)
+int64_t WebUIBase::getTimeUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
 void WebUIBase::setBuiltInFunctionHandlers()
 {
     setFunctionHandler("getInitWidthCSS", 0, [this](const Variant&, uintptr_t origin) {
@@ -25,6 +25,11 @@
 
 #include "distrho/extra/Mutex.hpp"
 
+#if defined(DPF_WEBUI_ALLOC_STATS)
+# include <map>
+# include "AllocStats.hpp"
+#endif
+
 #include "extra/UIEx.hpp"
 #include "extra/StringHash.hpp"
 #include "Variant.hpp"
@@ -88,6 +93,46 @@ protected:
 private:
     void setBuiltInFunctionHandlers();
 
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+    enum MessageStage
+    {
+        kMessageStageHandle,    // handleMessage() including the function handler
+        kMessageStageQueueWait, // queue() until the block starts running in uiIdle()
+        kMessageStageQueueRun,  // queued block execution
+        kMessageStageCallback,  // callback() including serialization and postMessage()
+        kMessageStageCount
+    };
+
+    struct MessageStageStats
+    {
+        uint64_t count;
+        int64_t  totalUs;
+        int64_t  maxUs;
+    };
+
+    void recordMessageStage(MessageStage stage, int64_t startUs);
+    void printMessageStats();
+#endif
+
+#if defined(DPF_WEBUI_ALLOC_STATS)
+    // Inclusive, handler figures also count callbacks made by the handler
+    struct AllocStatsEntry
+    {
+        uint64_t calls;
+        uint64_t count;
+        uint64_t bytes;
+    };
+
+    typedef std::map<std::string, AllocStatsEntry> AllocStatsMap;
+
+    void recordAllocStats(const char* kind, const char* name, const AllocCounter& allocs);
+    void printAllocStats();
+#endif
+
+#if defined(DPF_WEBUI_MESSAGE_STATS) || defined(DPF_WEBUI_ALLOC_STATS)
+    static int64_t getTimeUs();
+#endif
+
     uint fInitWidthCssPx;
     uint fInitHeightCssPx;
     FunctionArgumentSerializer fFuncArgSerializer;
@@ -98,6 +143,19 @@ private:
     typedef std::unordered_map<String, ArgumentCountAndFunctionHandler> FunctionHandlerMap;
     FunctionHandlerMap fHandler;
 
+#if defined(DPF_WEBUI_MESSAGE_STATS)
+    Mutex             fStatsMutex; // messages are handled from multiple threads
+    MessageStageStats fStageStats[kMessageStageCount];
+    int64_t           fStatsTime;
+#endif
+
+#if defined(DPF_WEBUI_ALLOC_STATS)
+    Mutex         fAllocStatsMutex;
+    AllocStatsMap fAllocStats;
+    int64_t       fAllocStatsTime;
+    std::unordered_map<String, String> fHandlerNames; // serialized function -> name
+#endif
+
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WebUIBase)
 
 };
@@ -24,6 +24,12 @@
                                "window.host.addMessageListener = (lr) => {" \
                                "  window.host.addEventListener('message', (ev) => lr(ev.detail))" \
                                "};" \
+                               "window.host.receiveMessage = (msg) => {" \
+                               "  window.host.dispatchEvent(new CustomEvent('message', {detail: msg}))" \
+                               "};" \
+                               "window.host.receiveMessages = (msgs) => {" \
+                               "  for (const msg of msgs) window.host.receiveMessage(msg)" \
+                               "};" \
                                "window.host.env = {};"
 #define JS_CREATE_CONSOLE  "window.console = {" \
                            "  log  : (s) => window.host.postMessage(['console', 'log'  , String(s)])," \
@@ -124,10 +130,15 @@ void WebViewBase::postMessage(const Variant& payload)
     if (fPrintTraffic) {
         d_stderr("cpp->js : %s", jsonPayload.buffer());
     }
-    
-    String js = "window.host.dispatchEvent(new CustomEvent('message',"
-                    "{detail:" + jsonPayload + "}"
-                "));";
+
+    deliverMessage(jsonPayload);
+}
+
+void WebViewBase::deliverMessage(String& jsonPayload)
+{
+    // Fallback for web views without a native message channel, compiles a
+    // script for every message.
+    String js = "window.host.receiveMessage(" + jsonPayload + ");";
     runScript(js);
 }
 
@@ -65,11 +65,24 @@ public:
     virtual void runScript(String& source) = 0;
     virtual void injectScript(String& source) = 0;
 
+    // Implementations that can map the plugin shared memory into the page
+    // expose the bytes after dataOffset as an ArrayBuffer at window.hostSharedMemory
+    virtual void setSharedMemory(const char* name, size_t size, size_t dataOffset)
+    {
+        (void)name;
+        (void)size;
+        (void)dataOffset;
+    }
+
 protected:
     virtual void onSize(uint width, uint height) = 0;
     virtual void onKeyboardFocus(bool focus) { (void)focus; };
     virtual void onSetParent(uintptr_t parent) { (void)parent; };
 
+    // Implementations should pass the message to window.host.receiveMessage()
+    // without building a script around the payload when the web view allows so
+    virtual void deliverMessage(String& jsonPayload);
+
     void injectHostObjectScripts();
     
     void handleLoadFinished();
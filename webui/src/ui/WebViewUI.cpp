@@ -37,6 +37,9 @@ WebViewUI::WebViewUI(uint widthCssPx, uint heightCssPx, const char* backgroundCs
 #if defined(DPF_WEBUI_NETWORK_UI)
     , fNavigated(false)
 #endif
+#if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
+    , fSharedMemoryMapped(false)
+#endif
 {
     setBuiltInFunctionHandlers();
 }
@@ -144,6 +147,16 @@ void WebViewUI::uiIdle()
 {
     WebViewUIBase::uiIdle();
 
+#if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
+    // Not done in sharedMemoryCreated() because subclasses can override it
+    if (! fSharedMemoryMapped && (fWebView != nullptr) && (getSharedMemoryPointer() != nullptr)) {
+        fSharedMemoryMapped = true;
+        fWebView->setSharedMemory(getSharedMemoryName(),
+                                  kSharedMemoryDataOffset + DPF_WEBUI_SHARED_MEMORY_SIZE,
+                                  kSharedMemoryDataOffset);
+    }
+#endif
+
     if (isStandalone()) {
         processStandaloneEvents();
     }
@@ -92,6 +92,9 @@ private:
 #if defined(DPF_WEBUI_NETWORK_UI)
     bool          fNavigated;
 #endif
+#if defined(DPF_WEBUI_SHARED_MEMORY_SIZE)
+    bool          fSharedMemoryMapped;
+#endif
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WebViewUI)
 
@@ -78,6 +78,10 @@ class UI {
 
     // void UI::setState(const char* key, const char* value)
     setState(key, value) {
+        const pending = this._statePending[key];
+        this._statePending[key] = { count: pending ? pending.count + 1 : 1, value: value };
+        this._states[key] = value;
+        delete this._stateVersions[key]; // see stateAcknowledged()
         this.call('setState', key, value);
     }
 
@@ -192,7 +196,30 @@ class UI {
     // Non-DPF method that writes to memory shared with DISTRHO::PluginEx instance
     // void UIEx::writeSharedMemory(const uint8_t* data, size_t size, size_t offset)
     writeSharedMemory(data /*Uint8Array*/, offset) {
-        this.call('writeSharedMemory', this._encodeBinaryDataIfNeeded(data), offset || 0);
+        const env = DISTRHO.env;
+
+        if (env.network && this._isProtocolBinary && this._socket
+                && (this._socket.readyState == WebSocket.OPEN)) {
+            // Send a raw frame that the server copies into shared memory as it
+            // arrives, skipping BSON encoding and intermediate buffers. Header
+            // layout is documented in NetworkUI.cpp.
+            const header = new DataView(new ArrayBuffer(12));
+            header.setUint32(0, 0xffffffff, true);
+            header.setInt32(4, this.constructor.djb2hash('writeSharedMemory'), true);
+            header.setUint32(8, offset || 0, true);
+            this._socket.send(new Blob([header, data]));
+        } else {
+            this.call('writeSharedMemory', this._encodeBinaryDataIfNeeded(data), offset || 0);
+        }
+    }
+
+    // Non-DPF method that returns the plugin shared memory as an ArrayBuffer
+    // that reads and writes the memory in place, or null if the web view
+    // cannot map it. Only Linux web views support it, once sharedMemoryCreated()
+    // has been called. Contents can change anytime.
+    // uint8_t* UIEx::getSharedMemoryPointer()
+    getSharedMemory() {
+        return window.hostSharedMemory || null;
     }
 
     // Non-DPF method that returns the plugin UI public URL
@@ -205,6 +232,13 @@ class UI {
         }
     }
 
+    // Non-DPF method that returns telemetry for the network clients connected
+    // to this plugin instance, see WebServer ClientStats for field details.
+    // ClientInfoVector WebServer::getClientInfo(int instance)
+    async getServerStats() {
+        return this.call('getServerStats');
+    }
+
     // Non-DPF method to check whether the plugin is published using Zeroconf
     async isZeroconfPublished() {
         return this.call('isZeroconfPublished');
@@ -261,6 +295,9 @@ class UI {
         this._latency = 0;
         this._pingSendTime = 0;
         this._callbackLookup = this;
+        this._states = {};
+        this._stateVersions = {};
+        this._statePending = {};
 
         const env = DISTRHO.env;
 
@@ -295,7 +332,8 @@ class UI {
         let pingTimer = null;
 
         const open = () => {
-            this._socket = new WebSocket(`ws://${document.location.host}`);
+            // Query string selects the plugin instance on the shared server
+            this._socket = new WebSocket(`ws://${document.location.host}/${document.location.search}`);
             this._socket.binaryType = 'arraybuffer';
 
             this._socket.addEventListener('open', (_) => {
@@ -365,6 +403,51 @@ class UI {
         this._log(`Latency = ${this._latency}ms`);
     }
 
+    // Coalesced parameter updates, payload is index, value, index, value...
+    parameterChangedBatch(...args) {
+        for (let i = 0; i < args.length - 1; i += 2) {
+            this.parameterChanged(args[i], args[i + 1]);
+        }
+    }
+
+    // Apply a splice to the last known state value, offsets in UTF-16 units.
+    // If the local copy is not the version the splice was computed against
+    // ask the server for the full value.
+    stateChangedDelta(key, offset, deleteCount, insert, baseVersion, version) {
+        if (key in this._statePending) {
+            return; // computed before the local change, see stateAcknowledged()
+        }
+
+        const base = this._states[key];
+
+        if ((base === undefined) || (this._stateVersions[key] !== baseVersion)) {
+            const funcArg = this._isProtocolBinary ? this.constructor.djb2hash('requestState')
+                            : 'requestState';
+            this.postMessage(funcArg, key);
+            return;
+        }
+
+        const value = base.substring(0, offset) + insert + base.substring(offset + deleteCount);
+        this._states[key] = value;
+        this._stateVersions[key] = version;
+        this.stateChanged(key, value);
+    }
+
+    // The server applied a local setState() call and assigned it a version.
+    // Messages arrive in the order the server sends them, so once the latest
+    // local change is acknowledged the server holds that value at version.
+    stateAcknowledged(key, version) {
+        const pending = this._statePending[key];
+
+        if (! pending || (--pending.count > 0)) {
+            return;
+        }
+
+        delete this._statePending[key];
+        this._states[key] = pending.value;
+        this._stateVersions[key] = version;
+    }
+
     // Handle incoming message
     _messageReceived(payload) {
         const func = this._callbackLookup[payload[0]];
@@ -377,6 +460,11 @@ class UI {
         const funcName = func.name;
         payload = payload.slice(1);
 
+        if (funcName == 'stateChanged') {
+            this._states[payload[0]] = payload[1]; // base for deltas
+            this._stateVersions[payload[0]] = payload[2];
+        }
+
         if (funcName in this._resolve) {
             for (let callback of this._resolve[funcName]) {
                 callback.resolve(...payload);
@@ -387,9 +475,16 @@ class UI {
         }
     }
 
-    // Encode binary data to base64 when the protocol is text-based
+    // Encode binary data to base64 when the protocol is text-based, unless
+    // the web view can pass typed arrays to native code as they are
     _encodeBinaryDataIfNeeded(data) {
-        return this._isProtocolBinary ? data : base64EncArr(data);
+        const env = DISTRHO.env;
+
+        if (this._isProtocolBinary || (env.plugin && !env.network && env.binaryMessages)) {
+            return data;
+        }
+
+        return base64EncArr(data);
     }
 
     // Reject all pending promises on channel disconnection
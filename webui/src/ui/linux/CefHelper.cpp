@@ -16,17 +16,33 @@
 
 #include "CefHelper.hpp"
 
+#include <cerrno>
 #include <cstddef>
+#include <cstring>
 #include <sstream>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <X11/Xutil.h>
 #include <X11/extensions/XInput2.h>
 
+#include "include/cef_version.h"
+
 #include "distrho/extra/sofd/libsofd.h"
 #include "extra/Path.hpp"
 #include "scaling.h"
 
-#define JS_POST_MESSAGE_SHIM "window.host.postMessage = (payload) => window.hostPostMessage(payload);"
+#if CEF_VERSION_MAJOR >= 119
+// V8 bindings can read ArrayBuffer contents but not typed array views
+# define JS_POST_MESSAGE_SHIM "window.host.postMessage = (payload) => window.hostPostMessage(payload.map((a) => " \
+                             "  ArrayBuffer.isView(a) ? a.buffer.slice(a.byteOffset, a.byteOffset + a.byteLength) : a));" \
+                             "window.host.env.binaryMessages = true;"
+#else
+# define JS_POST_MESSAGE_SHIM "window.host.postMessage = (payload) => window.hostPostMessage(payload);"
+#endif
 
 static int XErrorHandlerImpl(Display* display, XErrorEvent* event)
 {
@@ -207,12 +223,18 @@ void CefHelper::dispatch(const tlv_t& packet)
         case OP_RUN_SCRIPT:
             runScript(static_cast<const char*>(packet.v));
             break;
+        case OP_POST_MESSAGE:
+            postMessage(static_cast<const char*>(packet.v));
+            break;
         case OP_INJECT_SHIMS:
             injectScript(JS_POST_MESSAGE_SHIM);
             break;
         case OP_INJECT_SCRIPT: 
             injectScript(static_cast<const char*>(packet.v));
             break;
+        case OP_SET_SHARED_MEMORY:
+            setSharedMemory(static_cast<const msg_shared_memory_t*>(packet.v));
+            break;
         case OP_SET_SIZE:
             setSize(static_cast<const msg_view_size_t*>(packet.v));
             break;
@@ -448,11 +470,34 @@ void CefHelper::runScript(const char* js)
     frame->ExecuteJavaScript(js, frame->GetURL(), 0);
 }
 
+void CefHelper::postMessage(const char* json)
+{
+    // Renderer parses the payload and calls window.host.receiveMessage()
+    // directly through V8, see CefSubprocess::OnProcessMessageReceived()
+    CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("HostReceiveMessage");
+    message->GetArgumentList()->SetString(0, json);
+    fBrowser->GetMainFrame()->SendProcessMessage(PID_RENDERER, message);
+}
+
 void CefHelper::injectScript(const char* js)
 {
     fScripts->SetString(fScripts->GetSize(), js);
 }
 
+void CefHelper::setSharedMemory(const msg_shared_memory_t* shm)
+{
+    if (fBrowser == nullptr) {
+        return;
+    }
+
+    // Renderer maps the segment itself, see CefSubprocess::mapSharedMemory()
+    CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("HostSetSharedMemory");
+    message->GetArgumentList()->SetString(0, shm->name);
+    message->GetArgumentList()->SetDouble(1, static_cast<double>(shm->size));
+    message->GetArgumentList()->SetDouble(2, static_cast<double>(shm->dataOffset));
+    fBrowser->GetMainFrame()->SendProcessMessage(PID_RENDERER, message);
+}
+
 void CefHelper::setSize(const msg_view_size_t* size)
 {
     const unsigned width = size->width;
@@ -495,6 +540,12 @@ void CefHelper::setKeyboardFocus(bool keyboardFocus)
     }
 }
 
+CefSubprocess::CefSubprocess()
+{}
+
+CefSubprocess::~CefSubprocess()
+{}
+
 void CefSubprocess::OnContextCreated(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame,
                                            CefRefPtr<CefV8Context> context)
 {
@@ -503,6 +554,67 @@ void CefSubprocess::OnContextCreated(CefRefPtr<CefBrowser> browser, CefRefPtr<Ce
     window->SetValue("hostPostMessage", CefV8Value::CreateFunction("hostPostMessage", this),
                      V8_PROPERTY_ATTRIBUTE_NONE);
     fBrowser = browser;
+
+    if (frame->IsMain()) {
+        exposeSharedMemory(context);
+    }
+}
+
+bool CefSubprocess::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame,
+                                             CefProcessId sourceProcess, CefRefPtr<CefProcessMessage> message)
+{
+    if (sourceProcess != PID_BROWSER) {
+        return false;
+    }
+
+    if (message->GetName() == "HostSetSharedMemory") {
+        CefRefPtr<CefListValue> args = message->GetArgumentList();
+        CefRefPtr<CefV8Context> context = frame->GetV8Context();
+
+        if (mapSharedMemory(args->GetString(0).ToString(), static_cast<size_t>(args->GetDouble(1)),
+                            static_cast<size_t>(args->GetDouble(2)))
+                && (context != nullptr) && context->Enter()) {
+            exposeSharedMemory(context);
+            context->Exit();
+        }
+
+        return true;
+    }
+
+    if (message->GetName() != "HostReceiveMessage") {
+        return false;
+    }
+
+    CefRefPtr<CefV8Context> context = frame->GetV8Context();
+
+    if ((context == nullptr) || ! context->Enter()) {
+        return true;
+    }
+
+    CefRefPtr<CefV8Value> global = context->GetGlobal();
+    CefRefPtr<CefV8Value> json = global->GetValue("JSON");
+    CefRefPtr<CefV8Value> host = global->GetValue("host");
+
+    if ((json != nullptr) && json->IsObject() && (host != nullptr) && host->IsObject()) {
+        CefRefPtr<CefV8Value> parse = json->GetValue("parse");
+        CefRefPtr<CefV8Value> receive = host->GetValue("receiveMessage");
+
+        if (parse->IsFunction() && receive->IsFunction()) {
+            CefV8ValueList args;
+            args.push_back(CefV8Value::CreateString(message->GetArgumentList()->GetString(0)));
+            CefRefPtr<CefV8Value> payload = parse->ExecuteFunction(json, args);
+
+            if (payload != nullptr) {
+                args.clear();
+                args.push_back(payload);
+                receive->ExecuteFunction(host, args);
+            }
+        }
+    }
+
+    context->Exit();
+
+    return true;
 }
 
 bool CefSubprocess::Execute(const CefString& name, CefRefPtr<CefV8Value> object, const CefV8ValueList& arguments,
@@ -513,48 +625,161 @@ bool CefSubprocess::Execute(const CefString& name, CefRefPtr<CefV8Value> object,
         return false;
     }
 
-    char *payload = NULL;
-    int offset = 0;
+    // Serialize JS values into type;value chunks, see msg_js_arg_type_t
+    std::vector<char> payload;
+    CefRefPtr<CefV8Value> stringify;
 
     for (int i = 0; i < arguments[0]->GetArrayLength(); i++) {
         CefRefPtr<CefV8Value> arg = arguments[0]->GetValue(i);
 
         if (arg->IsBool()) {
-            payload = static_cast<char *>(realloc(payload, offset + 1));
-            int b = arg->GetBoolValue() ? ARG_TYPE_TRUE : ARG_TYPE_FALSE;
-            *(payload+offset) = static_cast<char>(b);
-            offset += 1;
+            payload.push_back(static_cast<char>(arg->GetBoolValue() ? ARG_TYPE_TRUE : ARG_TYPE_FALSE));
 
         } else if (arg->IsDouble()) {
-            payload = static_cast<char *>(realloc(payload, offset + 1 + sizeof(double)));
-            *(payload+offset) = static_cast<char>(ARG_TYPE_DOUBLE);
-            offset += 1;
-            *reinterpret_cast<double *>(payload+offset) = arg->GetDoubleValue();
-            offset += sizeof(double);
+            const double d = arg->GetDoubleValue();
+            const char* p = reinterpret_cast<const char*>(&d);
+            payload.push_back(static_cast<char>(ARG_TYPE_DOUBLE));
+            payload.insert(payload.end(), p, p + sizeof(d));
 
         } else if (arg->IsString()) {
-            std::string s = arg->GetStringValue().ToString();
-            int slen = s.length() + 1;
-            payload = static_cast<char *>(realloc(payload, offset + 1 + slen));
-            *(payload+offset) = static_cast<char>(ARG_TYPE_STRING);
-            offset += 1;
-            strcpy(payload+offset, s.c_str());
-            offset += slen;
+            const std::string s = arg->GetStringValue().ToString();
+            appendSizedArg(payload, ARG_TYPE_STRING, s.c_str(), s.length());
+#if CEF_VERSION_MAJOR >= 119
+        } else if (arg->IsArrayBuffer()) {
+            // Typed arrays are converted to ArrayBuffers by JS_POST_MESSAGE_SHIM
+            appendSizedArg(payload, ARG_TYPE_BINARY, arg->GetArrayBufferData(),
+                            static_cast<uint32_t>(arg->GetArrayBufferByteLength()));
+#endif
+        } else if (arg->IsArray() || arg->IsObject()) {
+            if (stringify == nullptr) {
+                CefRefPtr<CefV8Value> json = CefV8Context::GetCurrentContext()->GetGlobal()->GetValue("JSON");
+                stringify = json->GetValue("stringify");
+            }
+
+            CefV8ValueList args;
+            args.push_back(arg);
+            CefRefPtr<CefV8Value> json = stringify->ExecuteFunction(nullptr, args);
+
+            if ((json != nullptr) && json->IsString()) {
+                const std::string s = json->GetStringValue().ToString();
+                appendSizedArg(payload, ARG_TYPE_JSON, s.c_str(), s.length());
+            } else {
+                payload.push_back(static_cast<char>(ARG_TYPE_NULL));
+            }
 
         } else {
-            payload = static_cast<char *>(realloc(payload, offset + 1));
-            *(payload+offset) = static_cast<char>(ARG_TYPE_NULL);
-            offset += 1;
+            payload.push_back(static_cast<char>(ARG_TYPE_NULL));
         }
     }
 
     CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("HostPostMessage");
-    message->GetArgumentList()->SetBinary(0, CefBinaryValue::Create(payload, offset));
+    message->GetArgumentList()->SetBinary(0, CefBinaryValue::Create(payload.data(), payload.size()));
     fBrowser->GetMainFrame()->SendProcessMessage(PID_BROWSER, message);
 
-    if (payload) {
-        free(payload);
+    return true;
+}
+
+void CefSubprocess::appendSizedArg(std::vector<char>& payload, msg_js_arg_type_t type,
+                                   const void* value, uint32_t size)
+{
+    const char* s = reinterpret_cast<const char*>(&size);
+    const char* v = static_cast<const char*>(value);
+
+    payload.push_back(static_cast<char>(type));
+    payload.insert(payload.end(), s, s + sizeof(size));
+    payload.insert(payload.end(), v, v + size);
+
+    if (type != ARG_TYPE_BINARY) {
+        payload.push_back('\0');
+    }
+}
+
+bool CefSubprocess::mapSharedMemory(const std::string& name, size_t size, size_t dataOffset)
+{
+    if ((fSharedMemory != nullptr) && (fSharedMemory->getName() == name)) {
+        return true;
+    }
+
+    if (dataOffset > size) {
+        return false;
+    }
+
+    int fd;
+
+    if (name.compare(0, 6, "/proc/") == 0) {
+        fd = open(name.c_str(), O_RDWR); // memfd segment, see SharedMemory::create()
+    } else {
+        fd = shm_open(name.c_str(), O_RDWR, 0);
+    }
+
+    if (fd < 0) {
+        // Fails when the renderer sandbox does not expose /dev/shm
+        d_stderr2("Could not open shared memory - %s", strerror(errno));
+        return false;
+    }
+
+    // Map the whole file rounded up to its page size, huge page segments are
+    // larger than the size sent by the plugin and cannot be partially mapped
+    struct stat st;
+
+    if ((fstat(fd, &st) != 0) || (static_cast<size_t>(st.st_size) < size)) {
+        d_stderr2("Invalid shared memory size");
+        close(fd);
+        return false;
+    }
+
+    const size_t pageSize = st.st_blksize > 0 ? static_cast<size_t>(st.st_blksize)
+                                : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t mapSize = (static_cast<size_t>(st.st_size) + pageSize - 1) / pageSize * pageSize;
+
+    void* ptr = mmap(nullptr, mapSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (ptr == MAP_FAILED) {
+        d_stderr2("Could not map shared memory - %s", strerror(errno));
+        return false;
     }
 
+    // ArrayBuffers created from the previous mapping keep it alive until collected
+    fSharedMemory = new SharedMemoryMapping(name, ptr, size, mapSize, dataOffset);
+
     return true;
 }
+
+void CefSubprocess::exposeSharedMemory(CefRefPtr<CefV8Context> context)
+{
+    if (fSharedMemory == nullptr) {
+        return;
+    }
+
+    context->GetGlobal()->SetValue("hostSharedMemory", fSharedMemory->createArrayBuffer(),
+                                   V8_PROPERTY_ATTRIBUTE_NONE);
+}
+
+SharedMemoryMapping::SharedMemoryMapping(const std::string& name, void* ptr, size_t size,
+                                         size_t mapSize, size_t dataOffset)
+    : fName(name)
+    , fPtr(ptr)
+    , fSize(size)
+    , fMapSize(mapSize)
+    , fDataOffset(dataOffset)
+{}
+
+SharedMemoryMapping::~SharedMemoryMapping()
+{
+    munmap(fPtr, fMapSize);
+}
+
+CefRefPtr<CefV8Value> SharedMemoryMapping::createArrayBuffer()
+{
+    // Live view of the plugin shared memory, same as the WebKitGTK web extension
+    AddRef();
+
+    CefRefPtr<CefV8Value> buffer = CefV8Value::CreateArrayBuffer(static_cast<char*>(fPtr) + fDataOffset,
+                                                                 fSize - fDataOffset, this);
+    if (buffer == nullptr) {
+        Release(); // no buffer will be released
+    }
+
+    return buffer;
+}
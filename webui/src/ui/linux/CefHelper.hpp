@@ -136,7 +136,9 @@ private:
     void realize(const msg_view_cfg_t* config);
     void navigate(const char* url);
     void runScript(const char* js);
+    void postMessage(const char* json);
     void injectScript(const char* js);
+    void setSharedMemory(const msg_shared_memory_t* shm);
     void setSize(const msg_view_size_t* size);
     void setKeyboardFocus(bool keyboardFocus);
 
@@ -155,12 +157,43 @@ private:
     IMPLEMENT_REFCOUNTING(CefHelper);
 };
 
+// Plugin shared memory mapped into the renderer. Every ArrayBuffer created
+// from it holds a reference, the mapping is released once the last buffer is
+// collected and a newer segment has replaced it.
+class SharedMemoryMapping : public CefV8ArrayBufferReleaseCallback
+{
+public:
+    SharedMemoryMapping(const std::string& name, void* ptr, size_t size, size_t mapSize,
+                        size_t dataOffset);
+    virtual ~SharedMemoryMapping();
+
+    CefRefPtr<CefV8Value> createArrayBuffer();
+
+    const std::string& getName() const { return fName; }
+
+    // CefV8ArrayBufferReleaseCallback
+    void ReleaseBuffer(void* buffer) override
+    {
+        (void)buffer;
+        Release(); // reference taken by createArrayBuffer()
+    }
+
+private:
+    std::string fName;
+    void*       fPtr;
+    size_t      fSize;
+    size_t      fMapSize;
+    size_t      fDataOffset;
+
+    IMPLEMENT_REFCOUNTING(SharedMemoryMapping);
+};
+
 class CefSubprocess : public CefApp, public CefClient,
                       public CefRenderProcessHandler, public CefV8Handler
 {
 public:
-    CefSubprocess() {}
-    virtual ~CefSubprocess() {}
+    CefSubprocess();
+    virtual ~CefSubprocess();
 
     // CefApp
     CefRefPtr<CefRenderProcessHandler> GetRenderProcessHandler() override
@@ -171,13 +204,24 @@ public:
     // CefRenderProcessHandler
     void OnContextCreated(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame,
                           CefRefPtr<CefV8Context> context) override;
+
+    bool OnProcessMessageReceived(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame,
+                                  CefProcessId sourceProcess,
+                                  CefRefPtr<CefProcessMessage> message) override;
     
     // CefV8Handler
     bool Execute(const CefString& name, CefRefPtr<CefV8Value> object, const CefV8ValueList& arguments,
                  CefRefPtr<CefV8Value>& retval, CefString& exception) override;
 
 private:
-    CefRefPtr<CefBrowser> fBrowser;
+    bool mapSharedMemory(const std::string& name, size_t size, size_t dataOffset);
+    void exposeSharedMemory(CefRefPtr<CefV8Context> context);
+
+    static void appendSizedArg(std::vector<char>& payload, msg_js_arg_type_t type,
+                               const void* value, uint32_t size);
+
+    CefRefPtr<CefBrowser>          fBrowser;
+    CefRefPtr<SharedMemoryMapping> fSharedMemory;
 
     IMPLEMENT_REFCOUNTING(CefSubprocess);
 };
@@ -17,6 +17,7 @@
 #include "ChildProcessWebView.hpp"
 
 #include <cstdio>
+#include <cstring>
 #include <errno.h>
 #include <libgen.h>
 #include <spawn.h>
@@ -194,6 +195,14 @@ void ChildProcessWebView::runScript(String& source)
     fIpc->write(OP_RUN_SCRIPT, source);
 }
 
+void ChildProcessWebView::deliverMessage(String& jsonPayload)
+{
+    IF_CHANNEL_CLOSED_RETURN();
+
+    // Helper decides how to hand the payload to the page
+    fIpc->write(OP_POST_MESSAGE, jsonPayload);
+}
+
 void ChildProcessWebView::injectScript(String& source)
 {
     IF_CHANNEL_CLOSED_RETURN();
@@ -201,6 +210,19 @@ void ChildProcessWebView::injectScript(String& source)
     fIpc->write(OP_INJECT_SCRIPT, source);
 }
 
+void ChildProcessWebView::setSharedMemory(const char* name, size_t size, size_t dataOffset)
+{
+    IF_CHANNEL_CLOSED_RETURN();
+
+    msg_shared_memory_t shmPkt;
+    std::memset(&shmPkt, 0, sizeof(shmPkt));
+    std::strncpy(shmPkt.name, name, sizeof(shmPkt.name) - 1);
+    shmPkt.size = static_cast<uint64_t>(size);
+    shmPkt.dataOffset = static_cast<uint64_t>(dataOffset);
+
+    fIpc->write(OP_SET_SHARED_MEMORY, &shmPkt, sizeof(shmPkt));
+}
+
 void ChildProcessWebView::onSize(uint width, uint height)
 {
     IF_CHANNEL_CLOSED_RETURN();
@@ -247,33 +269,60 @@ void ChildProcessWebView::handleInit(float devicePixelRatio)
 void ChildProcessWebView::handleHelperScriptMessage(const char *payloadBytes,
                                                     int payloadSize)
 {
-    // Should validate payload is never read past payloadSize 
+    // Decode type;value chunks, see msg_js_arg_type_t
     Variant payload = Variant::createArray();
-    int offset = 0;
+    const char *p = payloadBytes;
+    const char *end = payloadBytes + payloadSize;
 
-    while (offset < payloadSize) {
-        const char *type = payloadBytes + offset;
-        const char *value = type + 1;
+    while (p < end) {
+        const char type = *p++;
+        const size_t available = static_cast<size_t>(end - p);
 
-        switch (*type) {
+        switch (type) {
             case ARG_TYPE_FALSE:
-                offset += 1;
                 payload.pushArrayItem(false);
                 break;
             case ARG_TYPE_TRUE:
-                offset += 1;
                 payload.pushArrayItem(true);
                 break;
-            case ARG_TYPE_DOUBLE:
-                offset += 1 + sizeof(double);
-                payload.pushArrayItem(*reinterpret_cast<const double *>(value));
+            case ARG_TYPE_DOUBLE: {
+                double d;
+                if (available < sizeof(d)) {
+                    d_stderr2("Truncated script message");
+                    return;
+                }
+                std::memcpy(&d, p, sizeof(d));
+                p += sizeof(d);
+                payload.pushArrayItem(d);
                 break;
+            }
             case ARG_TYPE_STRING:
-                offset += 1 /*type*/ + strlen(value) + 1 /*\0*/;
-                payload.pushArrayItem(static_cast<const char*>(value));
+            case ARG_TYPE_BINARY:
+            case ARG_TYPE_JSON: {
+                uint32_t size;
+                if (available < sizeof(size)) {
+                    d_stderr2("Truncated script message");
+                    return;
+                }
+                std::memcpy(&size, p, sizeof(size));
+                p += sizeof(size);
+                const size_t terminator = type == ARG_TYPE_BINARY ? 0 : 1;
+                if ((available - sizeof(size)) < (static_cast<size_t>(size) + terminator)) {
+                    d_stderr2("Truncated script message");
+                    return;
+                }
+                if (type == ARG_TYPE_STRING) {
+                    payload.pushArrayItem(p);
+                } else if (type == ARG_TYPE_BINARY) {
+                    const uint8_t *data = reinterpret_cast<const uint8_t *>(p);
+                    payload.pushArrayItem(BinaryData(data, data + size));
+                } else {
+                    payload.pushArrayItem(Variant::fromJSON(p));
+                }
+                p += size + terminator;
                 break;
+            }
             default:
-                offset += 1;
                 payload.pushArrayItem(Variant()); // null
                 break;
         }
@@ -42,10 +42,12 @@ public:
     void navigate(String& url) override;
     void runScript(String& source) override;
     void injectScript(String& source) override;
+    void setSharedMemory(const char* name, size_t size, size_t dataOffset) override;
 
 protected:
     void onSize(uint width, uint height) override;
     void onKeyboardFocus(bool focus) override;
+    void deliverMessage(String& jsonPayload) override;
 
 private:
     void ipcReadCallback(const tlv_t& message);
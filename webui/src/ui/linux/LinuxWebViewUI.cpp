@@ -77,8 +77,6 @@ void LinuxWebViewUI::onClientConnected(Client client)
 
     fFirstClient = true;
 
-    String userAgent(kWebViewUserAgent);
-    getServer().setClientUserAgent(client, userAgent);
-
+    setWebViewClient(client);
 }
 #endif
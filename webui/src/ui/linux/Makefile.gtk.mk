@@ -15,7 +15,8 @@ LXHELPER_CPPFLAGS = -I. -I$(DPF_WEBUI_INC_PATH) \
 LXHELPER_LDFLAGS = -lpthread -lX11 \
 				   $(shell $(PKG_CONFIG) --libs gtk+-3.0 webkit2gtk-4.0)
 
-lxhelper_bin: $(LXHELPER_BUILD_PATH)/$(LXHELPER_NAME)
+lxhelper_bin: $(LXHELPER_BUILD_PATH)/$(LXHELPER_NAME) \
+			  $(LXHELPER_BUILD_PATH)/$(LXHELPER_WEBEXT_DIR)/$(LXHELPER_WEBEXT_NAME)
 
 $(LXHELPER_BUILD_PATH)/$(LXHELPER_NAME): $(LXHELPER_OBJ)
 	@echo "Compiling $<"
@@ -27,6 +28,24 @@ $(LXHELPER_BUILD_PATH)/%.c.o: $(DPF_WEBUI_SRC_PATH)/ui/linux/%.c
 	@$(CC) $(LXHELPER_CPPFLAGS) -c $< -o $@
 
 # ------------------------------------------------------------------------------
-# Only copy the monolithic GTK helper binary
+# Build web extension that maps shared memory into the page, see gtk_webext.c
+# Directory name must match WEB_EXTENSIONS_DIR in gtk_helper.c
 
-LXHELPER_FILES = $(LXHELPER_BUILD_PATH)/$(LXHELPER_NAME)
+LXHELPER_WEBEXT_DIR = ui-helper-ext
+LXHELPER_WEBEXT_NAME = libui-helper-ext.so
+
+LXHELPER_WEBEXT_CPPFLAGS = -I. -I$(DPF_WEBUI_INC_PATH) -fPIC \
+						   $(shell $(PKG_CONFIG) --cflags webkit2gtk-web-extension-4.0)
+LXHELPER_WEBEXT_LDFLAGS = -shared -lrt \
+						  $(shell $(PKG_CONFIG) --libs webkit2gtk-web-extension-4.0)
+
+$(LXHELPER_BUILD_PATH)/$(LXHELPER_WEBEXT_DIR)/$(LXHELPER_WEBEXT_NAME): $(DPF_WEBUI_SRC_PATH)/ui/linux/gtk_webext.c
+	@mkdir -p $(dir $@)
+	@echo "Compiling $<"
+	@$(CC) $(LXHELPER_WEBEXT_CPPFLAGS) $< -o $@ $(LXHELPER_WEBEXT_LDFLAGS)
+
+# ------------------------------------------------------------------------------
+# Copy the monolithic GTK helper binary and its web extension
+
+LXHELPER_FILES = $(LXHELPER_BUILD_PATH)/$(LXHELPER_NAME) \
+				 $(LXHELPER_BUILD_PATH)/$(LXHELPER_WEBEXT_DIR)
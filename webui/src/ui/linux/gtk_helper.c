@@ -55,6 +55,23 @@
 
 #define JS_POST_MESSAGE_SHIM "window.host.postMessage = (payload) => window.webkit.messageHandlers.host.postMessage(payload);"
 
+// Lets dpf.js pass ArrayBuffers and typed arrays to native code as they are
+#define JS_BINARY_MESSAGES_ENV "window.host.env.binaryMessages = true;"
+
+// Messages are delivered in batches once per main loop iteration. WebKitGTK
+// 2.40 can call a constant function body with arguments, that avoids compiling
+// a new script for every batch.
+#define JS_RECEIVE_MESSAGES "window.host.receiveMessages(JSON.parse(m));"
+
+// Plugin shared memory is mapped into the page by a web extension that needs
+// WebKitGTK 2.38 for wrapping external memory in an ArrayBuffer
+#if defined(DPF_WEBUI_SHARED_MEMORY_SIZE) && WEBKIT_CHECK_VERSION(2,38,0)
+# define SHARED_MEMORY_WEB_EXTENSION 1
+# define WEB_EXTENSIONS_DIR "ui-helper-ext"
+#else
+# define SHARED_MEMORY_WEB_EXTENSION 0
+#endif
+
 typedef struct {
     ipc_t*          ipc;
     Display*        display;
@@ -67,20 +84,26 @@ typedef struct {
     gboolean        focus;
     Window          focusXWin;
     pthread_t       watchdog;
+    GString*        messages;
+    guint           messagesSource;
     char            scripts[262144];
 } context_t;
 
 static void realize(context_t *ctx, const msg_view_cfg_t *config);
 static void navigate(context_t *ctx, const char *url);
-static void run_script(const context_t *ctx, const char *js);
+static void run_script(context_t *ctx, const char *js);
+static void post_message(context_t *ctx, const char *json);
+static gboolean flush_messages(gpointer data);
 static void inject_script(context_t *ctx, const char *js);
+static void set_shared_memory(context_t *ctx, const msg_shared_memory_t *shm);
 static void set_size(context_t *ctx, const msg_view_size_t *size);
-static void apply_size(const context_t *ctx);
+static void apply_size(context_t *ctx);
 static void set_keyboard_focus(context_t *ctx, gboolean focus);
 static void* focus_watchdog_worker(void *arg);
 static gboolean release_focus(gpointer data);
 static void web_view_load_changed_cb(WebKitWebView *view, WebKitLoadEvent event, gpointer data);
 static void web_view_script_message_cb(WebKitUserContentManager *manager, WebKitJavascriptResult *res, gpointer data);
+static void append_sized_arg(GByteArray *payload, msg_js_arg_type_t type, const void *value, gsize size);
 static gboolean web_view_keypress_cb(GtkWidget *widget, GdkEventKey *event, gpointer data);
 static gboolean ipc_read_cb(GIOChannel *source, GIOCondition condition, gpointer data);
 static int ipc_write_simple(const context_t *ctx, msg_opcode_t opcode, const void *payload, int payload_sz);
@@ -104,6 +127,7 @@ int main(int argc, char* argv[])
     }
 
     ctx.ipc = ipc_init(&conf);
+    ctx.messages = g_string_new("[");
 
     ctx.display = XOpenDisplay(NULL);
     if (ctx.display == NULL) {
@@ -192,6 +216,21 @@ static void realize(context_t *ctx, const msg_view_cfg_t *config)
         name[sep - name] = '\0';
     }
 
+#if SHARED_MEMORY_WEB_EXTENSION
+    // Extension lives in a subdirectory because WebKit loads every library
+    // in the extensions directory, including the plugin binaries
+    gchar *exe = g_file_read_link("/proc/self/exe", NULL);
+
+    if (exe != NULL) {
+        gchar *dir = g_path_get_dirname(exe);
+        gchar *extDir = g_build_filename(dir, WEB_EXTENSIONS_DIR, NULL);
+        webkit_web_context_set_web_extensions_directory(webkit_web_context_get_default(), extDir);
+        g_free(extDir);
+        g_free(dir);
+        g_free(exe);
+    }
+#endif
+
     WebKitSettings *settings = webkit_settings_new();
     webkit_settings_set_user_agent_with_application_details(settings, name, version);
 
@@ -223,18 +262,90 @@ static void navigate(context_t *ctx, const char *url)
     webkit_web_view_load_uri(ctx->webView, url);
 }
 
-static void run_script(const context_t *ctx, const char *js)
+static void run_script(context_t *ctx, const char *js)
 {
+    // Keep ordering relative to messages
+    if (ctx->messagesSource != 0) {
+        g_source_remove(ctx->messagesSource);
+        flush_messages(ctx);
+    }
+
     if (ctx->webView != NULL) {
         webkit_web_view_run_javascript(ctx->webView, js, NULL, NULL, NULL);
     }
 }
 
+static void post_message(context_t *ctx, const char *json)
+{
+    if (ctx->messages->len > 1) {
+        g_string_append_c(ctx->messages, ',');
+    }
+
+    g_string_append(ctx->messages, json);
+
+    if (ctx->messagesSource == 0) {
+        ctx->messagesSource = g_idle_add(flush_messages, ctx);
+    }
+}
+
+static gboolean flush_messages(gpointer data)
+{
+    context_t *ctx = (context_t *)data;
+
+    ctx->messagesSource = 0;
+
+    if (ctx->messages->len < 2) {
+        return G_SOURCE_REMOVE;
+    }
+
+    g_string_append_c(ctx->messages, ']');
+
+    if (ctx->webView != NULL) {
+#if WEBKIT_CHECK_VERSION(2, 40, 0)
+        GVariantDict args;
+        g_variant_dict_init(&args, NULL);
+        g_variant_dict_insert(&args, "m", "s", ctx->messages->str);
+        webkit_web_view_call_async_javascript_function(ctx->webView, JS_RECEIVE_MESSAGES, -1,
+            g_variant_dict_end(&args), NULL, NULL, NULL, NULL, NULL);
+#else
+        GString *js = g_string_new("window.host.receiveMessages(");
+        g_string_append_len(js, ctx->messages->str, ctx->messages->len);
+        g_string_append(js, ");");
+        webkit_web_view_run_javascript(ctx->webView, js->str, NULL, NULL, NULL);
+        g_string_free(js, TRUE);
+#endif
+    }
+
+    g_string_truncate(ctx->messages, 1);
+
+    return G_SOURCE_REMOVE;
+}
+
 static void inject_script(context_t *ctx, const char *js)
 {
     strcat(ctx->scripts, (const char *)js);
 }
 
+static void set_shared_memory(context_t *ctx, const msg_shared_memory_t *shm)
+{
+#if SHARED_MEMORY_WEB_EXTENSION
+    // Also becomes the initialization data for web processes spawned later
+    GVariant *params = g_variant_ref_sink(g_variant_new("(stt)", shm->name, (guint64)shm->size,
+                                                        (guint64)shm->dataOffset));
+    webkit_web_context_set_web_extensions_initialization_user_data(webkit_web_context_get_default(), params);
+
+    if (ctx->webView != NULL) {
+        WebKitUserMessage *message = webkit_user_message_new(WEBEXT_MSG_SET_SHARED_MEMORY, params);
+        webkit_web_view_send_message_to_page(ctx->webView, message, NULL, NULL, NULL);
+    }
+
+    g_variant_unref(params);
+#else
+    (void)ctx;
+    (void)shm;
+#endif
+}
+
 static void set_size(context_t *ctx, const msg_view_size_t *size)
 {
     ctx->size = *size;
@@ -244,7 +355,7 @@ static void set_size(context_t *ctx, const msg_view_size_t *size)
     }
 }
 
-static void apply_size(const context_t *ctx)
+static void apply_size(context_t *ctx)
 {
     unsigned width = ctx->size.width;
     unsigned height = ctx->size.height;
@@ -355,13 +466,18 @@ static void web_view_load_changed_cb(WebKitWebView *view, WebKitLoadEvent event,
 
 static void web_view_script_message_cb(WebKitUserContentManager *manager, WebKitJavascriptResult *res, gpointer data)
 {
-    // Serialize JS values into type;value chunks. Available types are limited to
-    // those defined by msg_js_arg_type_t so there is no need to encode value sizes.
+    // Serialize JS values into type;value chunks, see msg_js_arg_type_t
     gint32 numArgs, i;
     JSCValue *jsArg;
     JSCValue *jsArgs = webkit_javascript_result_get_js_value(res);
-    char *payload = NULL;
-    int offset = 0;
+    GByteArray *payload = g_byte_array_new();
+    guint8 type;
+    double d;
+    char *s;
+#if WEBKIT_CHECK_VERSION(2,38,0)
+    gpointer p;
+    gsize size;
+#endif
 
     if (jsc_value_is_array(jsArgs)) {
         numArgs = jsc_value_to_int32(jsc_value_object_get_property(jsArgs, "length"));
@@ -370,44 +486,68 @@ static void web_view_script_message_cb(WebKitUserContentManager *manager, WebKit
             jsArg = jsc_value_object_get_property_at_index(jsArgs, i);
 
             if (jsc_value_is_boolean(jsArg)) {
-                payload = (char *)realloc(payload, offset + 1);
-                if (jsc_value_to_boolean(jsArg)) {
-                    *(payload+offset) = (char)ARG_TYPE_TRUE;
-                } else {
-                    *(payload+offset) = (char)ARG_TYPE_FALSE;
-                }
-                offset += 1;
+                type = jsc_value_to_boolean(jsArg) ? ARG_TYPE_TRUE : ARG_TYPE_FALSE;
+                g_byte_array_append(payload, &type, 1);
 
             } else if (jsc_value_is_number(jsArg)) {
-                payload = (char *)realloc(payload, offset + 1 + sizeof(double));
-                *(payload+offset) = (char)ARG_TYPE_DOUBLE;
-                offset += 1;
-                *(double *)(payload+offset) = jsc_value_to_double(jsArg);
-                offset += sizeof(double);
+                type = ARG_TYPE_DOUBLE;
+                d = jsc_value_to_double(jsArg);
+                g_byte_array_append(payload, &type, 1);
+                g_byte_array_append(payload, (const guint8 *)&d, sizeof(d));
 
             } else if (jsc_value_is_string(jsArg)) {
-                const char *s = jsc_value_to_string(jsArg);
-                int slen = strlen(s) + 1;
-                payload = (char *)realloc(payload, offset + 1 + slen);
-                *(payload+offset) = (char)ARG_TYPE_STRING;
-                offset += 1;
-                strcpy(payload+offset, s);
-                offset += slen;
+                s = jsc_value_to_string(jsArg);
+                append_sized_arg(payload, ARG_TYPE_STRING, s, strlen(s));
+                g_free(s);
+#if WEBKIT_CHECK_VERSION(2,38,0)
+            } else if (jsc_value_is_typed_array(jsArg)) {
+                // Copy bytes straight from the JS heap, no base64 round trip
+                p = jsc_value_typed_array_get_data(jsArg, NULL);
+                size = jsc_value_typed_array_get_size(jsArg);
+                append_sized_arg(payload, ARG_TYPE_BINARY, p, size);
+
+            } else if (jsc_value_is_array_buffer(jsArg)) {
+                p = jsc_value_array_buffer_get_data(jsArg, &size);
+                append_sized_arg(payload, ARG_TYPE_BINARY, p, size);
+#endif
+            } else if (jsc_value_is_array(jsArg) || jsc_value_is_object(jsArg)) {
+                s = jsc_value_to_json(jsArg, 0);
+
+                if (s != NULL) {
+                    append_sized_arg(payload, ARG_TYPE_JSON, s, strlen(s));
+                    g_free(s);
+                } else {
+                    type = ARG_TYPE_NULL;
+                    g_byte_array_append(payload, &type, 1);
+                }
 
             } else {
-                payload = (char *)realloc(payload, offset + 1);
-                *(payload+offset) = (char)ARG_TYPE_NULL;
-                offset += 1;
+                type = ARG_TYPE_NULL;
+                g_byte_array_append(payload, &type, 1);
             }
+
+            g_object_unref(jsArg);
         }
     }
 
     webkit_javascript_result_unref(res);
 
-    ipc_write_simple((context_t *)data, OP_HANDLE_SCRIPT_MESSAGE, payload, offset);
+    ipc_write_simple((context_t *)data, OP_HANDLE_SCRIPT_MESSAGE, payload->data, payload->len);
+
+    g_byte_array_unref(payload);
+}
 
-    if (payload) {
-        free(payload);
+static void append_sized_arg(GByteArray *payload, msg_js_arg_type_t type, const void *value, gsize size)
+{
+    const guint8 t = (guint8)type;
+    const uint32_t size32 = (uint32_t)size;
+
+    g_byte_array_append(payload, &t, 1);
+    g_byte_array_append(payload, (const guint8 *)&size32, sizeof(size32));
+    g_byte_array_append(payload, (const guint8 *)value, size32);
+
+    if (type != ARG_TYPE_BINARY) {
+        g_byte_array_append(payload, (const guint8 *)"", 1);
     }
 }
 
@@ -445,12 +585,21 @@ static gboolean ipc_read_cb(GIOChannel *source, GIOCondition condition, gpointer
         case OP_RUN_SCRIPT:
             run_script(ctx, (const char *)packet.v);
             break;
+        case OP_POST_MESSAGE:
+            post_message(ctx, (const char *)packet.v);
+            break;
         case OP_INJECT_SHIMS:
             inject_script(ctx, JS_POST_MESSAGE_SHIM);
+#if WEBKIT_CHECK_VERSION(2,38,0)
+            inject_script(ctx, JS_BINARY_MESSAGES_ENV);
+#endif
             break;
         case OP_INJECT_SCRIPT:
             inject_script(ctx, (const char *)packet.v);
             break;
+        case OP_SET_SHARED_MEMORY:
+            set_shared_memory(ctx, (const msg_shared_memory_t *)packet.v);
+            break;
         case OP_SET_SIZE:
             set_size(ctx, (const msg_view_size_t *)packet.v);
             break;
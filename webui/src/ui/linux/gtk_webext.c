@@ -0,0 +1,195 @@
+/*
+ * dpfwebui / Web User Interfaces support for DISTRHO Plugin Framework
+ * Copyright (C) 2021-2024 Luciano Iam <oss@lucianoiam.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Loaded by the WebKitGTK web process. Maps the plugin shared memory and wraps
+// it in an ArrayBuffer at window.hostSharedMemory so the page can read DSP
+// data in place instead of receiving it through serialized messages. The
+// buffer is a live view, reads always return the current memory contents.
+// Every buffer holds a reference to its mapping, a mapping replaced by a new
+// segment is only unmapped once the last buffer created from it is collected.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <webkit2/webkit-web-extension.h>
+
+#include "ipc_message.h"
+
+#define JS_GLOBAL_NAME "hostSharedMemory"
+
+typedef struct {
+    char   name[64];
+    void*  ptr;
+    gsize  size;
+    gsize  mapSize;
+    gsize  dataOffset;
+    gint   refCount;
+} shared_memory_t;
+
+static shared_memory_t *shm; // current mapping
+
+static gboolean map_shared_memory(GVariant *params);
+static void shared_memory_unref(gpointer data);
+static void expose_shared_memory(WebKitFrame *frame);
+static void page_created_cb(WebKitWebExtension *extension, WebKitWebPage *page, gpointer data);
+static gboolean page_user_message_received_cb(WebKitWebPage *page, WebKitUserMessage *message, gpointer data);
+static void window_object_cleared_cb(WebKitScriptWorld *world, WebKitWebPage *page, WebKitFrame *frame,
+                                     gpointer data);
+
+G_MODULE_EXPORT void webkit_web_extension_initialize_with_user_data(WebKitWebExtension *extension,
+                                                                    const GVariant *userData)
+{
+    if (userData != NULL) {
+        map_shared_memory((GVariant *)userData);
+    }
+
+    g_signal_connect(extension, "page-created", G_CALLBACK(page_created_cb), NULL);
+    g_signal_connect(webkit_script_world_get_default(), "window-object-cleared",
+                     G_CALLBACK(window_object_cleared_cb), NULL);
+}
+
+static gboolean map_shared_memory(GVariant *params)
+{
+    const gchar *name;
+    guint64 size, dataOffset;
+    struct stat st;
+    gsize pageSize, mapSize;
+    int fd;
+    void *ptr;
+
+    if ((params == NULL) || ! g_variant_is_of_type(params, G_VARIANT_TYPE("(stt)"))) {
+        return FALSE;
+    }
+
+    g_variant_get(params, "(&stt)", &name, &size, &dataOffset);
+
+    if (dataOffset > size) {
+        return FALSE;
+    }
+
+    if ((shm != NULL) && (strcmp(shm->name, name) == 0)) {
+        return TRUE;
+    }
+
+    if (strncmp(name, "/proc/", 6) == 0) {
+        fd = open(name, O_RDWR); // memfd segment, see SharedMemory::create()
+    } else {
+        fd = shm_open(name, O_RDWR, 0);
+    }
+
+    if (fd < 0) {
+        // Fails when the web process sandbox does not expose /dev/shm
+        fprintf(stderr, "gtk_webext : could not open shared memory - %s\n", strerror(errno));
+        return FALSE;
+    }
+
+    // Map the whole file rounded up to its page size, huge page segments are
+    // larger than the size sent by the plugin and cannot be partially mapped
+    if ((fstat(fd, &st) != 0) || ((guint64)st.st_size < size)) {
+        fprintf(stderr, "gtk_webext : invalid shared memory size\n");
+        close(fd);
+        return FALSE;
+    }
+
+    pageSize = st.st_blksize > 0 ? (gsize)st.st_blksize : (gsize)sysconf(_SC_PAGESIZE);
+    mapSize = ((gsize)st.st_size + pageSize - 1) / pageSize * pageSize;
+
+    ptr = mmap(NULL, mapSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "gtk_webext : could not map shared memory - %s\n", strerror(errno));
+        return FALSE;
+    }
+
+    // Buffers created from the previous mapping keep it alive until collected
+    if (shm != NULL) {
+        shared_memory_unref(shm);
+    }
+
+    shm = g_new0(shared_memory_t, 1);
+    g_strlcpy(shm->name, name, sizeof(shm->name));
+    shm->ptr = ptr;
+    shm->size = size;
+    shm->mapSize = mapSize;
+    shm->dataOffset = dataOffset;
+    shm->refCount = 1;
+
+    return TRUE;
+}
+
+static void shared_memory_unref(gpointer data)
+{
+    shared_memory_t *mapping = (shared_memory_t *)data;
+
+    // Buffers can be finalized by the garbage collector from another thread
+    if (g_atomic_int_dec_and_test(&mapping->refCount)) {
+        munmap(mapping->ptr, mapping->mapSize);
+        g_free(mapping);
+    }
+}
+
+static void expose_shared_memory(WebKitFrame *frame)
+{
+    JSCContext *context;
+    JSCValue *buffer;
+
+    if (shm == NULL) {
+        return;
+    }
+
+    g_atomic_int_inc(&shm->refCount);
+
+    context = webkit_frame_get_js_context(frame);
+    buffer = jsc_value_new_array_buffer(context, (char *)shm->ptr + shm->dataOffset,
+                                        shm->size - shm->dataOffset, shared_memory_unref, shm);
+    jsc_context_set_value(context, JS_GLOBAL_NAME, buffer);
+
+    g_object_unref(buffer);
+    g_object_unref(context);
+}
+
+static void page_created_cb(WebKitWebExtension *extension, WebKitWebPage *page, gpointer data)
+{
+    g_signal_connect(page, "user-message-received", G_CALLBACK(page_user_message_received_cb), NULL);
+}
+
+static gboolean page_user_message_received_cb(WebKitWebPage *page, WebKitUserMessage *message, gpointer data)
+{
+    if (strcmp(webkit_user_message_get_name(message), WEBEXT_MSG_SET_SHARED_MEMORY) != 0) {
+        return FALSE;
+    }
+
+    if (map_shared_memory(webkit_user_message_get_parameters(message))) {
+        expose_shared_memory(webkit_web_page_get_main_frame(page));
+    }
+
+    return TRUE;
+}
+
+static void window_object_cleared_cb(WebKitScriptWorld *world, WebKitWebPage *page, WebKitFrame *frame,
+                                     gpointer data)
+{
+    // Runs before user scripts on every navigation
+    if (webkit_frame_is_main_frame(frame)) {
+        expose_shared_memory(frame);
+    }
+}
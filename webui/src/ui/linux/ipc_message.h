@@ -23,6 +23,8 @@ typedef enum {
     OP_REALIZE,
     OP_NAVIGATE,
     OP_RUN_SCRIPT,
+    OP_POST_MESSAGE,
+    OP_SET_SHARED_MEMORY,
     OP_INJECT_SHIMS,
     OP_INJECT_SCRIPT,
     OP_SET_SIZE,
@@ -33,12 +35,18 @@ typedef enum {
     OP_HANDLE_LOAD_FINISHED
 } msg_opcode_t;
 
+// OP_HANDLE_SCRIPT_MESSAGE payload is a sequence of type;value chunks. Null and
+// booleans have no value, doubles are stored as is. Strings, binary data and
+// JSON are prefixed with a uint32_t byte count, strings and JSON also carry a
+// trailing null not included in that count. Values are not aligned.
 typedef enum {
     ARG_TYPE_NULL,
     ARG_TYPE_FALSE,
     ARG_TYPE_TRUE,
     ARG_TYPE_DOUBLE,
-    ARG_TYPE_STRING
+    ARG_TYPE_STRING,
+    ARG_TYPE_BINARY, // ArrayBuffer or typed array contents
+    ARG_TYPE_JSON    // nested arrays and objects
 } msg_js_arg_type_t;
 
 typedef struct {
@@ -46,6 +54,16 @@ typedef struct {
     unsigned height;
 } msg_view_size_t;
 
+typedef struct {
+    char     name[64];
+    uint64_t size;       // whole segment
+    uint64_t dataOffset; // start of the region exposed to the page
+} msg_shared_memory_t;
+
+// WebKitGTK helper forwards msg_shared_memory_t to the web extension using a
+// user message with this name and (stt) parameters, see gtk_webext.c
+#define WEBEXT_MSG_SET_SHARED_MEMORY "SetSharedMemory"
+
 typedef struct {
     uintptr_t       parent;
     uint32_t        color;
@@ -146,6 +146,25 @@ void CocoaWebView::runScript(String& source)
     [js release];
 }
 
+void CocoaWebView::deliverMessage(String& jsonPayload)
+{
+#if defined(MAC_OS_VERSION_11_0)
+    // Function body is constant and gets compiled once, the payload is passed
+    // as an argument instead of being embedded into the script source
+    if (@available(macOS 11.0, *)) {
+        NSString *json = [[NSString alloc] initWithCString:jsonPayload encoding:NSUTF8StringEncoding];
+        [fNsWebView callAsyncJavaScript:@"window.host.receiveMessage(JSON.parse(m))"
+                              arguments:@{@"m": json}
+                                inFrame:nil
+                         inContentWorld:WKContentWorld.pageWorld
+                      completionHandler:nil];
+        [json release];
+        return;
+    }
+#endif
+    WebViewBase::deliverMessage(jsonPayload);
+}
+
 void CocoaWebView::injectScript(String& source)
 {
     NSString *js = [[NSString alloc] initWithCString:source encoding:NSUTF8StringEncoding];
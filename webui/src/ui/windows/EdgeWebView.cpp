@@ -32,7 +32,8 @@
 
 #define WEBVIEW2_DOWNLOAD_URL "https://developer.microsoft.com/en-us/microsoft-edge/webview2/#download-section"
 
-#define JS_POST_MESSAGE_SHIM  "window.host.postMessage = (payload) => window.chrome.webview.postMessage(payload);"
+#define JS_POST_MESSAGE_SHIM  "window.host.postMessage = (payload) => window.chrome.webview.postMessage(payload);" \
+                              "window.chrome.webview.addEventListener('message', (ev) => window.host.receiveMessage(ev.data));"
 
 #define WSTR_CONVERTER std::wstring_convert<std::codecvt_utf8<wchar_t>>()
 #define TO_LPCWSTR(s)  WSTR_CONVERTER.from_bytes(s).c_str()
@@ -235,6 +236,16 @@ void EdgeWebView::runScript(String& source)
     ICoreWebView2_ExecuteScript(fView, TO_LPCWSTR(source), 0);
 }
 
+void EdgeWebView::deliverMessage(String& jsonPayload)
+{
+    if ((fView == nullptr) || ! fReady) {
+        return;
+    }
+
+    // Parsed by the browser into a structured object, no script compilation
+    ICoreWebView2_PostWebMessageAsJson(fView, TO_LPCWSTR(jsonPayload));
+}
+
 void EdgeWebView::injectScript(String& source)
 {
     if (fController == nullptr) {
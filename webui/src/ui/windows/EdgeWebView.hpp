@@ -79,6 +79,7 @@ public:
 
 protected:
     void onSize(uint width, uint height) override;
+    void deliverMessage(String& jsonPayload) override;
 
 private:
     void errorMessageBox(std::wstring message);